@@ -0,0 +1,194 @@
+#include "alloc_stats.h"
+
+#ifdef MPW_SHELL_ALLOC_STATS
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+	const char *stage_names[ALLOC_STAGES] = {
+		"other",
+		"parse",
+		"expand",
+		"tokenize",
+		"evaluate",
+		"builtin",
+		"launch",
+	};
+
+	std::atomic<uint64_t> stage_count[ALLOC_STAGES];
+	std::atomic<uint64_t> stage_bytes[ALLOC_STAGES];
+
+	// plain thread_locals only -- these are used from operator new.
+	thread_local alloc_stage_t current = ALLOC_OTHER;
+	thread_local uint64_t thread_count = 0;
+	thread_local uint64_t thread_bytes = 0;
+	thread_local bool paused = false;
+
+	struct command_total {
+		uint64_t calls = 0;
+		alloc_count total;
+	};
+
+	std::mutex &commands_mutex() {
+		static std::mutex m;
+		return m;
+	}
+
+	std::map<std::string, command_total> &commands() {
+		static std::map<std::string, command_total> m;
+		return m;
+	}
+
+	// the bookkeeping's own allocations aren't counted.
+	struct pause {
+		bool _previous = paused;
+		pause() { paused = true; }
+		~pause() { paused = _previous; }
+	};
+
+	void *counted(size_t size) noexcept {
+		if (!paused) {
+			stage_count[current].fetch_add(1, std::memory_order_relaxed);
+			stage_bytes[current].fetch_add(size, std::memory_order_relaxed);
+			++thread_count;
+			thread_bytes += size;
+		}
+		return malloc(size ? size : 1);
+	}
+
+}
+
+
+void *operator new(size_t size) {
+	void *p = counted(size);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size) {
+	void *p = counted(size);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	return counted(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return counted(size);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+
+
+alloc_stage::alloc_stage(alloc_stage_t stage) : _previous(current) {
+	current = stage;
+}
+
+alloc_stage::~alloc_stage() {
+	current = _previous;
+}
+
+
+alloc_command::alloc_command() : _begin(alloc_thread_total()) {
+}
+
+alloc_command::~alloc_command() {
+	if (_name.empty()) return;
+	alloc_count end = alloc_thread_total();
+
+	pause p;
+	std::lock_guard<std::mutex> lock(commands_mutex());
+	auto &t = commands()[_name];
+	t.calls++;
+	t.total.count += end.count - _begin.count;
+	t.total.bytes += end.bytes - _begin.bytes;
+}
+
+
+alloc_count alloc_thread_total() {
+	alloc_count rv;
+	rv.count = thread_count;
+	rv.bytes = thread_bytes;
+	return rv;
+}
+
+
+std::string alloc_stats_summary() {
+
+	pause p;
+	std::string rv;
+	char buffer[256];
+
+	snprintf(buffer, sizeof(buffer), "# Allocations by stage\n# %-10s %12s %14s\n", "stage", "count", "bytes");
+	rv += buffer;
+	for (int i = 0; i < ALLOC_STAGES; ++i) {
+		snprintf(buffer, sizeof(buffer), "# %-10s %12llu %14llu\n", stage_names[i],
+			(unsigned long long)stage_count[i].load(std::memory_order_relaxed),
+			(unsigned long long)stage_bytes[i].load(std::memory_order_relaxed));
+		rv += buffer;
+	}
+
+	std::vector<std::pair<std::string, command_total>> v;
+	{
+		std::lock_guard<std::mutex> lock(commands_mutex());
+		v.assign(commands().begin(), commands().end());
+	}
+	if (v.empty()) return rv;
+
+	std::sort(v.begin(), v.end(), [](const auto &a, const auto &b){
+		return a.second.total.count > b.second.total.count;
+	});
+	if (v.size() > 20) v.resize(20);
+
+	// a script's count includes the commands it ran.
+	snprintf(buffer, sizeof(buffer), "# Allocations by command\n# %8s %12s %14s %10s  %s\n",
+		"calls", "count", "bytes", "per call", "command");
+	rv += buffer;
+	for (const auto &kv : v) {
+		const auto &t = kv.second;
+		snprintf(buffer, sizeof(buffer), "# %8llu %12llu %14llu %10.1f  ",
+			(unsigned long long)t.calls, (unsigned long long)t.total.count,
+			(unsigned long long)t.total.bytes, (double)t.total.count / t.calls);
+		rv += buffer;
+		rv += kv.first;
+		rv.push_back('\n');
+	}
+	return rv;
+}
+
+void alloc_stats_reset() {
+	for (int i = 0; i < ALLOC_STAGES; ++i) {
+		stage_count[i].store(0, std::memory_order_relaxed);
+		stage_bytes[i].store(0, std::memory_order_relaxed);
+	}
+	pause p;
+	std::lock_guard<std::mutex> lock(commands_mutex());
+	commands().clear();
+}
+
+#else
+
+std::string alloc_stats_summary() {
+	return std::string();
+}
+
+void alloc_stats_reset() {
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef __alloc_stats_h__
+#define __alloc_stats_h__
+
+#include "config.h"
+
+#include <cstdint>
+#include <string>
+
+/*
+ * cmake -DMPW_SHELL_ALLOC_STATS=ON replaces operator new with one that
+ * counts allocations (and bytes requested) by the stage the current thread
+ * is in and by command.  AllocStats prints the totals; with -P, each span
+ * in the trace gets its allocations and the summary includes the totals.
+ *
+ * without the option, alloc_stage and alloc_command do nothing.
+ */
+
+enum alloc_stage_t {
+	ALLOC_OTHER,
+	ALLOC_PARSE,
+	ALLOC_EXPAND,
+	ALLOC_TOKENIZE,
+	ALLOC_EVALUATE,
+	ALLOC_BUILTIN,
+	ALLOC_LAUNCH,
+	ALLOC_STAGES
+};
+
+struct alloc_count {
+	uint64_t count = 0;
+	uint64_t bytes = 0;
+};
+
+#ifdef MPW_SHELL_ALLOC_STATS
+
+const bool alloc_stats_enabled = true;
+
+// tags allocations on this thread until destroyed.
+class alloc_stage {
+public:
+	alloc_stage(alloc_stage_t stage);
+	~alloc_stage();
+	alloc_stage(const alloc_stage &) = delete;
+	alloc_stage &operator=(const alloc_stage &) = delete;
+private:
+	alloc_stage_t _previous;
+};
+
+// charges everything this thread allocates while it's alive to a command.
+class alloc_command {
+public:
+	alloc_command();
+	~alloc_command();
+	alloc_command(const alloc_command &) = delete;
+	alloc_command &operator=(const alloc_command &) = delete;
+	void name(const std::string &s) { _name = s; }
+private:
+	std::string _name;
+	alloc_count _begin;
+};
+
+// everything allocated by this thread so far.
+alloc_count alloc_thread_total();
+
+#else
+
+const bool alloc_stats_enabled = false;
+
+class alloc_stage {
+public:
+	alloc_stage(alloc_stage_t) {}
+};
+
+class alloc_command {
+public:
+	void name(const std::string &) {}
+};
+
+inline alloc_count alloc_thread_total() { return alloc_count(); }
+
+#endif
+
+// per stage and per command tables, as # comment lines.
+std::string alloc_stats_summary();
+void alloc_stats_reset();
+
+#endif
@@ -0,0 +1,111 @@
+#include "ast_arena.h"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+
+	thread_local ast_arena *current = nullptr;
+
+	// every node is preceded by its arena (nullptr for the heap).
+	// 16 bytes keeps the node 16-byte aligned.
+	struct alignas(16) header {
+		ast_arena *arena;
+	};
+
+	size_t round_up(size_t size) {
+		return (size + 15) & ~(size_t)15;
+	}
+
+}
+
+
+ast_arena::~ast_arena() {
+	for (char *cp : _chunks) ::operator delete(cp);
+	for (char *cp : _large_chunks) ::operator delete(cp);
+}
+
+
+ast_arena::scope::scope(ast_arena &a) : _previous(current) {
+	current = &a;
+}
+
+ast_arena::scope::~scope() {
+	current = _previous;
+}
+
+
+void *ast_arena::bump(size_t size) {
+
+	// bigger than a chunk -- give it one of its own.
+	if (size > chunk_size) {
+		char *cp = (char *)::operator new(size);
+		_large_chunks.push_back(cp);
+		_large += size;
+		return cp;
+	}
+
+	if (_chunk < _chunks.size() && _offset + size > chunk_size) {
+		++_chunk;
+		_offset = 0;
+	}
+	if (_chunk == _chunks.size()) {
+		char *cp = (char *)::operator new(chunk_size);
+		_chunks.push_back(cp);
+	}
+	char *cp = _chunks[_chunk] + _offset;
+	_offset += size;
+	return cp;
+}
+
+
+void ast_arena::recycle() noexcept {
+	_chunk = 0;
+	_offset = 0;
+	_used = 0;
+	for (char *cp : _large_chunks) ::operator delete(cp);
+	_large_chunks.clear();
+	_large = 0;
+	_strings.clear();
+}
+
+
+void *ast_arena::allocate(size_t size) {
+
+	size = round_up(size) + sizeof(header);
+
+	ast_arena *a = current;
+	header *h;
+	if (a) {
+		h = (header *)a->bump(size);
+		++a->_live;
+		a->_used += size;
+		a->_peak = std::max(a->_peak, a->_used);
+	}
+	else {
+		h = (header *)::operator new(size);
+	}
+	h->arena = a;
+	return h + 1;
+}
+
+
+void ast_arena::deallocate(void *p) noexcept {
+	if (!p) return;
+	header *h = (header *)p - 1;
+	ast_arena *a = h->arena;
+	if (!a) {
+		::operator delete(h);
+		return;
+	}
+	if (--a->_live == 0) a->recycle();
+}
+
+
+const std::string &ast_arena::intern(std::string &&s) {
+	// nodes made without an arena share a table that's never emptied.
+	static thread_local std::unordered_set<std::string> heap_strings;
+
+	auto &table = current ? current->_strings : heap_strings;
+	return *table.insert(std::move(s)).first;
+}
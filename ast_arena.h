@@ -0,0 +1,72 @@
+#ifndef __ast_arena_h__
+#define __ast_arena_h__
+
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * memory for one parser's command tree.
+ *
+ * command nodes are bump-allocated from the current arena (set by
+ * mpw_parser while phase3 runs) and deleting one only counts it.  once
+ * nothing is live -- every parsed command has executed -- the whole arena
+ * is recycled at once.  each node's destructor still runs (and frees its
+ * text and child vector from the heap); only the node memory is pooled.
+ * End and a bare Else are interned, so the many copies of "End" share one
+ * string; header lines (For f in ...) are nearly always unique and aren't.
+ *
+ * without a current arena, nodes come from the heap as usual.
+ */
+class ast_arena {
+
+public:
+
+	ast_arena() = default;
+	~ast_arena();
+
+	ast_arena(const ast_arena &) = delete;
+	ast_arena &operator=(const ast_arena &) = delete;
+
+	// for command::operator new / operator delete.
+	static void *allocate(size_t size);
+	static void deallocate(void *p) noexcept;
+
+	// a string that lives as long as the nodes using it.
+	static const std::string &intern(std::string &&s);
+
+	size_t reserved() const noexcept { return _chunks.size() * chunk_size + _large; }
+	size_t peak() const noexcept { return _peak; }
+	size_t live() const noexcept { return _live; }
+	size_t interned() const noexcept { return _strings.size(); }
+
+	class scope {
+	public:
+		scope(ast_arena &a);
+		~scope();
+		scope(const scope &) = delete;
+		scope &operator=(const scope &) = delete;
+	private:
+		ast_arena *_previous;
+	};
+
+private:
+
+	static const size_t chunk_size = 64 * 1024;
+
+	void *bump(size_t size);
+	void recycle() noexcept;
+
+	std::vector<char *> _chunks;
+	std::vector<char *> _large_chunks;
+	size_t _chunk = 0;
+	size_t _offset = 0;
+	size_t _large = 0;
+	size_t _live = 0;
+	size_t _used = 0;
+	size_t _peak = 0;
+	std::unordered_set<std::string> _strings;
+};
+
+#endif
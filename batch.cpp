@@ -0,0 +1,97 @@
+#include "batch.h"
+#include "environment.h"
+#include "mpw-shell.h"
+#include "parallel.h"
+#include "error.h"
+#include "echo_buffer.h"
+#include "profile.h"
+
+#include <chrono>
+#include <fstream>
+
+#include <cctype>
+#include <cstdio>
+
+namespace {
+
+	bool read_manifest(const std::string &path, std::vector<std::string> &out) {
+		std::ifstream in(path);
+		if (!in) return false;
+		std::string line;
+		while (std::getline(in, line)) {
+			while (!line.empty() && isspace((unsigned char)line.back())) line.pop_back();
+			size_t pos = line.find_first_not_of(" \t");
+			if (pos == std::string::npos || line[pos] == '#') continue;
+			out.push_back(line.substr(pos));
+		}
+		return true;
+	}
+
+}
+
+
+int run_batch(Environment &env, const std::vector<std::string> &args, unsigned jobs) {
+
+	std::vector<std::string> scripts;
+	for (const auto &s : args) {
+		if (s.size() > 1 && s.front() == '@') {
+			if (!read_manifest(s.substr(1), scripts)) {
+				fprintf(stderr, "### MPW Shell - Unable to open manifest %s.\n", s.c_str() + 1);
+				return -1;
+			}
+			continue;
+		}
+		scripts.push_back(s);
+	}
+
+	if (!jobs) jobs = parallel_runner::default_jobs(env);
+
+	std::vector<int> status(scripts.size(), 0);
+	size_t done = 0;
+	auto begin = std::chrono::steady_clock::now();
+
+	// results come back in the order the scripts were started.
+	parallel_runner runner(env, fdmask(), jobs, [&](const parallel_runner::result &r){
+		status[done++] = r.status;
+		return true;
+	});
+
+	profile_span span("batch", std::to_string(scripts.size()));
+	for (const auto &path : scripts) {
+		bool ok = runner.run([&env, &path](const fdmask &fds){
+			Environment new_env = env.subshell_environment();
+			new_env.set("command", path);
+			new_env.set_argv({ path });
+			try {
+				return read_file(new_env, path, fds);
+			} catch (const quit_command_t &) {
+				return 0;
+			}
+		});
+		if (!ok || env.control_c()) break;
+	}
+	runner.finish();
+
+	auto elapsed = std::chrono::steady_clock::now() - begin;
+	double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() / 1000.0;
+
+	int rv = 0;
+	size_t failed = 0;
+	for (size_t i = 0; i < done; ++i) {
+		if (!status[i]) continue;
+		if (!rv) rv = status[i];
+		++failed;
+	}
+
+	echo_flush();
+	fprintf(stderr, "# Batch - %zu scripts, %zu succeeded, %zu failed", scripts.size(), done - failed, failed);
+	if (done < scripts.size()) fprintf(stderr, ", %zu not run", scripts.size() - done);
+	fprintf(stderr, " (%u jobs, %.2f s)\n", jobs, seconds);
+	for (size_t i = 0; i < done; ++i) {
+		if (status[i]) fprintf(stderr, "#   %s - status %d\n", scripts[i].c_str(), status[i]);
+	}
+
+	if (env.control_c()) return -9;
+	if (done < scripts.size() && !rv) rv = -9;
+	return rv;
+}
@@ -0,0 +1,24 @@
+#ifndef __batch_h__
+#define __batch_h__
+
+#include <string>
+#include <vector>
+
+class Environment;
+
+/*
+ * mpw-shell -B [-j jobs] script...
+ *
+ * runs independent scripts at the same time, after Startup has run once.
+ * each script runs in a forked copy of the shell with a fresh subshell
+ * environment (as if it were run as a command).  output is captured and
+ * written a script at a time, in order.  a summary goes to stderr.
+ *
+ * @file names a manifest -- one script per line; blank lines and lines
+ * starting with # are ignored.
+ *
+ * returns 0 or the first non-zero status.
+ */
+int run_batch(Environment &env, const std::vector<std::string> &args, unsigned jobs);
+
+#endif
@@ -0,0 +1,101 @@
+#!/bin/sh
+#
+# end-to-end make benchmark using the stub mpw emulator.
+#
+# make-bench.sh [-n commands] [-s sleep-us] [-r runs] [build-dir]
+#
+# builds a throwaway MPW root ($HOME/mpw with a Startup file and stub tools),
+# then times:
+#   parse  mpw-make --test  (read_make/read_fd throughput, nothing executed)
+#   make   mpw-make         (every command runs the stub)
+#   sh     the same commands run by /bin/sh (baseline)
+# results are printed as json.  overhead_us is the per-command cost of
+# mpw-shell over /bin/sh.
+#
+
+set -e
+
+count=1000
+sleep_us=0
+runs=3
+
+while getopts "n:s:r:" opt; do
+	case $opt in
+		n) count=$OPTARG ;;
+		s) sleep_us=$OPTARG ;;
+		r) runs=$OPTARG ;;
+		*) echo "Usage: $0 [-n commands] [-s sleep-us] [-r runs] [build-dir]" >&2; exit 64 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+build=$(cd "${1:-.}" && pwd)
+shell="$build/mpw-shell"
+stub="$build/stub/mpw"
+
+for f in "$shell" "$stub"; do
+	if [ ! -x "$f" ]; then
+		echo "### $0 - $f not found (make mpw-shell mpw-stub)" >&2
+		exit 1
+	fi
+done
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp/mpw/Tools" "$tmp/mpw/Libraries" "$tmp/work/obj"
+for t in Make SC Link Rez; do
+	: > "$tmp/mpw/Tools/$t"
+done
+cat > "$tmp/mpw/Startup" <<EOF
+Set -e Commands "$tmp/mpw/Tools/"
+Set -e Libraries "$tmp/mpw/Libraries/"
+Set -e Debug 1
+EOF
+
+"$stub" --generate "$count" --sh > "$tmp/baseline.sh"
+
+# mpw_path() finds the stub first, root() uses $HOME/mpw/
+HOME=$tmp
+PATH="$build/stub:$PATH"
+MPW_STUB="$stub"
+MPW_LIBRARIES="$tmp/mpw/Libraries"
+MPW_STUB_SLEEP=$sleep_us
+MPW_STUB_COUNT=$count
+export HOME PATH MPW_STUB MPW_LIBRARIES MPW_STUB_SLEEP MPW_STUB_COUNT
+
+now() {
+	date +%s%N
+}
+
+# best of $runs, in nanoseconds.
+best() {
+	b=
+	i=0
+	while [ $i -lt "$runs" ]; do
+		start=$(now)
+		"$@" > /dev/null 2>&1
+		end=$(now)
+		t=$((end - start))
+		if [ -z "$b" ] || [ $t -lt $b ]; then b=$t; fi
+		i=$((i + 1))
+	done
+	echo $b
+}
+
+cd "$tmp/work"
+parse=$(best "$shell" make --test)
+make=$(best "$shell" make)
+sh=$(best /bin/sh "$tmp/baseline.sh")
+
+cat <<EOF
+{
+  "commands": $count,
+  "sleep_us": $sleep_us,
+  "parse_ms": $((parse / 1000000)),
+  "parse_us_per_command": $((parse / 1000 / count)),
+  "make_ms": $((make / 1000000)),
+  "sh_ms": $((sh / 1000000)),
+  "overhead_us": $(((make - sh) / 1000 / count))
+}
+EOF
@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+# compare the native Make with the emulated one.
+#
+# make-compare.sh [-a make-args] [-k] [-n] build-dir corpus-dir...
+#
+# every directory under corpus-dir with a MakeFile is copied to a temporary
+# directory, its Setup script (if any) is run there to create targets and
+# set dates, and then it's run through
+#   mpw-make --dry-run          (the Make tool under the emulator)
+#   mpw-make --native --dry-run
+# and the scripts are diffed.  needs a real mpw emulator and MPW root.
+# a directory with a Snapshot file is diffed against that, too.  Snapshots
+# are native make's output, checked by hand against the Make tool's rules --
+# not the Make tool's own output -- so they catch regressions in --native,
+# not differences from Make.
+# -a passes extra arguments (eg, "-e" or a target) to both.
+# -k keeps going after the first difference.
+# -n only checks --native against Snapshot, so no emulator is needed:
+#   make-compare.sh -n build bench/make-corpus
+#
+
+args=
+keep=0
+native_only=0
+usage="Usage: $0 [-a make-args] [-k] [-n] build-dir corpus-dir..."
+
+while getopts "a:kn" opt; do
+	case $opt in
+		a) args=$OPTARG ;;
+		k) keep=1 ;;
+		n) native_only=1 ;;
+		*) echo "$usage" >&2; exit 64 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 2 ]; then
+	echo "$usage" >&2
+	exit 64
+fi
+
+shell="$(cd "$1" && pwd)/mpw-shell"
+shift
+
+if [ ! -x "$shell" ]; then
+	echo "### $0 - $shell not found" >&2
+	exit 1
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+total=0
+failed=0
+
+for makefile in $(find "$@" -name MakeFile -type f | sort); do
+	dir=$(dirname "$makefile")
+	total=$((total + 1))
+
+	if [ $native_only -eq 1 ] && [ ! -f "$dir/Snapshot" ]; then
+		total=$((total - 1))
+		continue
+	fi
+
+	# git doesn't keep dates, so Setup sets them on a copy.
+	rm -rf "$tmp/case"
+	cp -R "$dir" "$tmp/case"
+	if [ -f "$tmp/case/Setup" ]; then
+		(cd "$tmp/case" && sh ./Setup) || { echo "### $dir - Setup failed" >&2; exit 1; }
+	fi
+
+	# the Make tool writes mac line endings.
+	(cd "$tmp/case" && "$shell" make --native --dry-run $args 2>&1) | tr '\r' '\n' > "$tmp/native"
+	: > "$tmp/diff"
+	if [ $native_only -eq 0 ]; then
+		(cd "$tmp/case" && "$shell" make --dry-run $args 2>&1) | tr '\r' '\n' > "$tmp/emulated"
+		diff -u "$tmp/emulated" "$tmp/native" >> "$tmp/diff"
+	fi
+	if [ -f "$dir/Snapshot" ]; then
+		diff -u "$dir/Snapshot" "$tmp/native" >> "$tmp/diff"
+	fi
+
+	if [ -s "$tmp/diff" ]; then
+		failed=$((failed + 1))
+		echo "### $dir"
+		grep -v -e '^--- ' -e '^+++ ' "$tmp/diff"
+		[ $keep -eq 1 ] || break
+	fi
+done
+
+echo "# $total makefiles, $failed different"
+[ $failed -eq 0 ]
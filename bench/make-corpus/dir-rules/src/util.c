@@ -0,0 +1,3 @@
+#include "defs.h"
+
+int helper(void) { return 0; }
@@ -0,0 +1 @@
+resource 'vers' (1) { 0x01, 0x00, release, 0x00, 0, "1.0", "1.0" };
@@ -0,0 +1 @@
+resource 'STR ' (128) { "app" };
@@ -0,0 +1,3 @@
+#include "defs.h"
+
+int main(void) { return helper(); }
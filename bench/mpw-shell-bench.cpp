@@ -0,0 +1,581 @@
+/*
+ * mpw-shell-bench [-o file] [-t seconds] [filter ...]
+ * mpw-shell-bench [-o file] -p lines
+ *
+ * microbenchmarks for the tokenizer, expander, environment, quoting,
+ * pathname conversion, macroman conversion, regular expressions,
+ * expression evaluation and whole-script parsing.
+ *
+ * results are written as json (to stdout or -o file) so two builds can be
+ * compared; a human readable summary goes to stderr.
+ *
+ * -p parses (but doesn't run) one script of that many lines and reports
+ * the parse time and peak memory.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include "mpw-shell.h"
+#include "mpw_parser.h"
+#include "mpw-regex.h"
+#include "environment.h"
+#include "fdset.h"
+#include "macroman.h"
+#include "echo_buffer.h"
+#include "transcode.h"
+#include "fd_cache.h"
+
+#include "version.h"
+
+namespace ToolBox {
+	std::string MacToUnix(const std::string path);
+	std::string UnixToMac(const std::string path);
+	void PathCacheStats(uint64_t &hits, uint64_t &misses);
+}
+
+bool must_quote(const std::string &s);
+
+namespace {
+
+	// keep the optimizer from discarding results.
+	volatile size_t sink;
+
+	struct result {
+		std::string name;
+		uint64_t iterations;
+		size_t bytes;
+		double ns_per_op;
+		double min_ns_per_op;
+		double max_ns_per_op;
+	};
+
+	struct benchmark {
+		const char *name;
+		std::function<size_t()> fx;
+		size_t bytes = 0; // per op, for throughput.
+	};
+
+	double min_time = 0.25;
+	const int samples = 5;
+
+	double run_batch(const benchmark &b, uint64_t n) {
+		size_t x = 0;
+		auto begin = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < n; ++i) x += b.fx();
+		auto end = std::chrono::steady_clock::now();
+		sink = x;
+		return std::chrono::duration<double, std::nano>(end - begin).count();
+	}
+
+	result run(const benchmark &b) {
+
+		// calibrate so each sample takes about min_time / samples.
+		double target = min_time * 1e9 / samples;
+		uint64_t n = 1;
+		for(;;) {
+			double t = run_batch(b, n);
+			if (t >= target || n >= (uint64_t)1 << 40) break;
+			if (t < target / 100) n *= 10;
+			else n = std::max(n + 1, (uint64_t)(n * target * 1.2 / t));
+		}
+
+		std::vector<double> v;
+		for (int i = 0; i < samples; ++i)
+			v.push_back(run_batch(b, n) / n);
+		std::sort(v.begin(), v.end());
+
+		return result{ b.name, n * samples, b.bytes, v[samples / 2], v.front(), v.back() };
+	}
+
+
+	std::string json_string(const std::string &s) {
+		std::string rv = "\"";
+		for (char c : s) {
+			if (c == '"' || c == '\\') rv.push_back('\\');
+			rv.push_back(c);
+		}
+		rv.push_back('"');
+		return rv;
+	}
+
+	void write_json(FILE *fp, const std::vector<result> &results) {
+
+		fprintf(fp, "{\n");
+		fprintf(fp, "  \"version\": %s,\n", json_string(VERSION).c_str());
+#if defined(__clang__)
+		fprintf(fp, "  \"compiler\": %s,\n", json_string("clang " __clang_version__).c_str());
+#elif defined(__GNUC__)
+		fprintf(fp, "  \"compiler\": %s,\n", json_string("gcc " __VERSION__).c_str());
+#endif
+		fprintf(fp, "  \"time\": %lld,\n", (long long)time(nullptr));
+		uint64_t hits, misses;
+		ToolBox::PathCacheStats(hits, misses);
+		fprintf(fp, "  \"path_cache\": {\"hits\": %llu, \"misses\": %llu},\n",
+			(unsigned long long)hits, (unsigned long long)misses);
+		fprintf(fp, "  \"benchmarks\": [\n");
+		bool first = true;
+		for (const auto &r : results) {
+			if (!first) fprintf(fp, ",\n");
+			first = false;
+			fprintf(fp, "    {\"name\": %s, \"iterations\": %llu, \"ns_per_op\": %.2f, "
+				"\"min_ns_per_op\": %.2f, \"max_ns_per_op\": %.2f",
+				json_string(r.name).c_str(), (unsigned long long)r.iterations,
+				r.ns_per_op, r.min_ns_per_op, r.max_ns_per_op);
+			if (r.bytes) fprintf(fp, ", \"mb_per_sec\": %.1f", r.bytes * 1000.0 / r.ns_per_op);
+			fprintf(fp, "}");
+		}
+		fprintf(fp, "\n  ]\n}\n");
+	}
+
+
+	std::string make_script(int lines) {
+		std::string s;
+		for (int i = 0; i < lines; ++i) {
+			switch (i % 8) {
+			case 0: s += "Set CFlags \"-w -opt speed -d DEBUG={Debug}\"\n"; break;
+			case 1: s += "Set Objects \"{Objects} file" + std::to_string(i) + ".c.o\"\n"; break;
+			case 2: s += "If {Debug} == 1 && \"{CFlags}\" =~ /*-opt*/\n"; break;
+			case 3: s += "\tEcho \"debug build\" > Dev:Null\n"; break;
+			case 4: s += "Else\n\tEcho 'release build' \xb6\n\t\t'continued' > Dev:Null\nEnd\n"; break;
+			case 5: s += "Evaluate x = (" + std::to_string(i) + " + 3) * 2 - {x}\n"; break;
+			case 6: s += "For f in a.c b.c c.c\n\tSet Last \"{f}\"\nEnd\n"; break;
+			case 7: s += "# comment line " + std::to_string(i) + "\n"; break;
+			}
+		}
+		return s;
+	}
+
+	struct temp_file {
+		char path[32] = "/tmp/mpw-shell-bench-XXXXXX";
+		int fd = mkstemp(path);
+		~temp_file() {
+			if (fd >= 0) {
+				close(fd);
+				unlink(path);
+			}
+		}
+	};
+
+	// open (and close) the same >> file 16 times.
+	size_t append_16(const std::string &command) {
+		size_t rv = 0;
+		for (int i = 0; i < 16; ++i) {
+			process p;
+			std::string s = command;
+			parse_tokens(tokenize(s, false), p);
+			rv += p.arguments.size();
+		}
+		return rv;
+	}
+
+	// the whole script is one If 0 ... End, so the tree is built but never run.
+	int parse_large(Environment &env, const fdmask &fds, int lines, FILE *fp) {
+
+		std::string script = "If 0\n" + make_script(lines - 2) + "End\n";
+		lines = std::count(script.begin(), script.end(), '\n');
+
+		mpw_parser p(env, fds);
+		auto begin = std::chrono::steady_clock::now();
+		p.parse(script);
+		p.finish();
+		auto end = std::chrono::steady_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - begin).count();
+		struct rusage ru;
+		getrusage(RUSAGE_SELF, &ru);
+		// kilobytes on linux, bytes on darwin.
+#if defined(__APPLE__)
+		long long rss = ru.ru_maxrss / 1024;
+#else
+		long long rss = ru.ru_maxrss;
+#endif
+		const auto &a = p.arena();
+
+		fprintf(stderr, "parsed %d lines (%zu bytes) in %.1f ms, peak rss %lld KB, arena %zu KB (peak %zu KB), %zu strings\n",
+			lines, script.size(), ms, rss, a.reserved() / 1024, a.peak() / 1024, a.interned());
+
+		fprintf(fp, "{\n");
+		fprintf(fp, "  \"version\": %s,\n", json_string(VERSION).c_str());
+		fprintf(fp, "  \"lines\": %d,\n", lines);
+		fprintf(fp, "  \"bytes\": %zu,\n", script.size());
+		fprintf(fp, "  \"parse_ms\": %.2f,\n", ms);
+		fprintf(fp, "  \"max_rss_kb\": %lld,\n", rss);
+		fprintf(fp, "  \"arena\": {\"reserved\": %zu, \"peak\": %zu, \"interned\": %zu}\n",
+			a.reserved(), a.peak(), a.interned());
+		fprintf(fp, "}\n");
+		return 0;
+	}
+
+	// every macroman character round-trips through utf-8, in one piece and a byte at a time.
+	bool check_macroman() {
+
+		struct { uint8_t macroman; uint16_t unicode; } mapping[] = {
+#undef _
+#define _(macroman, unicode, comment) { macroman, unicode },
+#include "macroman.x"
+#undef _
+		};
+
+		bool ok = true;
+		std::string all;
+		for (const auto &m : mapping) {
+			if (unicode_to_macroman(m.unicode) != m.macroman || macroman_to_unicode(m.macroman) != m.unicode) {
+				fprintf(stderr, "### macroman %02x <-> U+%04x mismatch\n", m.macroman, m.unicode);
+				ok = false;
+			}
+		}
+		for (int c = 1; c < 256; ++c) all.push_back(c);
+
+		std::string u = macroman_to_utf8(all);
+		if (utf8_to_macroman(u) != all) {
+			fprintf(stderr, "### macroman -> utf-8 -> macroman round trip failed\n");
+			ok = false;
+		}
+
+		std::string tmp(u.size(), 0);
+		uint32_t state = 0;
+		size_t n = 0;
+		for (char c : u) n += utf8_to_macroman(&c, 1, &tmp[n], state);
+		tmp.resize(n);
+		if (tmp != all || state) {
+			fprintf(stderr, "### streaming utf-8 -> macroman round trip failed\n");
+			ok = false;
+		}
+		return ok;
+	}
+
+	void usage() {
+		fputs("Usage: mpw-shell-bench [-o file] [-t seconds] [-l] [filter ...]\n", stdout);
+		fputs("       mpw-shell-bench [-o file] -p lines\n", stdout);
+		fputs("\t-o file      write json results to file (default stdout)\n", stdout);
+		fputs("\t-t seconds   minimum time per benchmark (default 0.25)\n", stdout);
+		fputs("\t-l           list benchmarks\n", stdout);
+		fputs("\t-p lines     time parsing one script of that many lines\n", stdout);
+	}
+}
+
+
+int main(int argc, char **argv) {
+
+	std::string output;
+	bool list = false;
+	int parse_lines = 0;
+
+	int c;
+	while ((c = getopt(argc, argv, "o:t:lp:h")) != -1) {
+		switch (c) {
+			case 'o': output = optarg; break;
+			case 't': min_time = strtod(optarg, nullptr); break;
+			case 'l': list = true; break;
+			case 'p': parse_lines = atoi(optarg); break;
+			case 'h': usage(); exit(0);
+			default: usage(); exit(EX_USAGE);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (!check_macroman()) return 1;
+
+	int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	fdmask null_fds(-1, null_fd, null_fd);
+
+	Environment env;
+	env.set("mpw", "/usr/local/share/mpw/mpw/");
+	env.set("echo", 0);
+	env.set("exit", 0);
+	env.set("debug", 1);
+	env.set("x", 12);
+	env.set("cflags", "-w -opt speed -d DEBUG=1", true);
+	env.set("objects", "a.c.o b.c.o c.c.o d.c.o", true);
+	for (int i = 0; i < 100; ++i)
+		env.set("var" + std::to_string(i), std::to_string(i), i & 1);
+
+	const std::string plain = "Link -w -c 'MPS ' -t MPST -o Tool file1.c.o file2.c.o \"{Libraries}\"Stubs.o";
+	const std::string vars = "SC {CFlags} -o \"{Objects}\" {Var1}{Var50} \"{Var99}\" 'unexpanded {Var2}'";
+	const std::string complex = "Echo \"a b\" 'c d' \xb6\"e\xb6\" f || Echo g && Echo h > Dev:Null \xb3 out";
+	const std::string expr = "({x} + 3) * 2 - 4 / 2 == 22 && \"{CFlags}\" =~ /*-opt*/";
+	const std::string quoted = "path with spaces and 'quotes'";
+	const std::string unquoted = "simple_path.c.o";
+	const std::string mac_path = "{MPW}Interfaces:CIncludes:Types.h";
+	const std::string mac_rel = ":::Sources:Lib:file.c";
+	const std::string mac_file = "Types.h";
+	std::vector<std::string> mac_paths;
+	for (int i = 0; i < 4096; ++i)
+		mac_paths.push_back(":Sources:Dir" + std::to_string(i % 64) + ":file" + std::to_string(i) + ".c");
+	size_t mac_index = 0;
+	const std::string utf8_ascii = "The quick brown fox jumps over the lazy dog. 0123456789";
+	const std::string utf8_mixed = "caf\xc3\xa9 \xe2\x80\xa2 r\xc3\xa9sum\xc3\xa9 \xc6\x92 \xe2\x88\x82 \xe2\x89\xa0 \xe2\x88\x9e";
+	std::string text_mac(64 * 1024, 0);
+	for (size_t i = 0; i < text_mac.size(); ++i)
+		text_mac[i] = i % 61 == 60 ? '\n' : i % 37 == 0 ? (char)(0x80 + i % 128) : 'a' + i % 26;
+	const std::string text_utf8 = macroman_to_utf8(text_mac);
+	std::vector<char> text_buffer(text_mac.size() * 3);
+	std::string tool_output;
+	for (int i = 0; i < 16; ++i) tool_output += text_mac;
+
+	std::vector<std::string> parameters;
+	for (int i = 0; i <= 1000; ++i)
+		parameters.push_back("file" + std::to_string(i) + ".c");
+
+	// Set Objects "{Objects} {f}" in a For loop.  the ≥ Dev:Null variant
+	// can't be done in place.
+	auto list_script = [](int n, bool in_place) {
+		std::string s = "Set Objects \"\"\nFor f in";
+		for (int i = 0; i < n; ++i) s += " file" + std::to_string(i) + ".c.o";
+		s += "\n\tSet Objects \"{Objects} {f}\"";
+		if (!in_place) s += " \xb3 Dev:Null";
+		s += "\nEnd\n";
+		return s;
+	};
+	const std::string script_list_5k = list_script(5000, true);
+	const std::string script_list_5k_slow = list_script(5000, false);
+	const std::string script_list_50k = list_script(50000, true);
+
+	const std::string script_small = make_script(64);
+	const std::string script_large = make_script(4096);
+
+	temp_file log;
+	if (log.fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	env.set("log", log.path);
+	const std::string append = std::string("Echo \"x\" >> ") + log.path;
+	const std::string script_log = "For i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16\n"
+		"\tEcho \"line {i}\" >> \"{Log}\"\n"
+		"\tEcho \"more {i}\" \xb3\xb3 \"{Log}\" >> \"{Log}\"\n"
+		"End\n";
+
+	mpw_regex glob("*.c.o", false);
+	mpw_regex re("/(:[A-Za-z]+)+\xa8""1:([A-Za-z]+)\xa8""2.c/", true);
+
+	std::vector<benchmark> benchmarks = {
+		{ "tokenize/plain", [&]{
+			std::string s = plain;
+			return tokenize(s, false).size();
+		}},
+		{ "tokenize/complex", [&]{
+			std::string s = complex;
+			return tokenize(s, false).size();
+		}},
+		{ "tokenize/eval", [&]{
+			std::string s = expr;
+			return tokenize(s, true).size();
+		}},
+
+		{ "expand_vars/none", [&]{
+			return expand_vars(plain, env, null_fds).size();
+		}},
+		{ "expand_vars/vars", [&]{
+			return expand_vars(vars, env, null_fds).size();
+		}},
+
+		{ "environment/find_hit", [&]{
+			auto iter = env.find("Var42");
+			return iter == env.end() ? (size_t)0 : strlen(iter->second.c_str());
+		}},
+		{ "environment/find_miss", [&]{
+			auto iter = env.find("NoSuchVariable");
+			return iter == env.end() ? (size_t)0 : strlen(iter->second.c_str());
+		}},
+		{ "environment/set", [&]{
+			env.set("BenchVariable", plain);
+			return (size_t)1;
+		}},
+		{ "environment/shift-1000", [&]{
+			// Loop ... {1} ... Shift ... End over 1000 parameters.
+			Environment e;
+			e.set_argv(parameters);
+			size_t n = 0;
+			while (e.pound()) {
+				n += e.get("1").size();
+				e.shift(1);
+			}
+			return n;
+		}},
+
+		{ "quote/must_quote", [&]{
+			return (size_t)must_quote(unquoted) + must_quote(quoted);
+		}},
+		{ "quote/quote", [&]{
+			return quote(quoted).size() + quote(unquoted).size();
+		}},
+
+		{ "MacToUnix/absolute", [&]{
+			return ToolBox::MacToUnix(mac_path).size();
+		}},
+		{ "MacToUnix/relative", [&]{
+			return ToolBox::MacToUnix(mac_rel).size();
+		}},
+		{ "MacToUnix/no-colon", [&]{
+			return ToolBox::MacToUnix(mac_file).size();
+		}},
+		{ "MacToUnix/miss", [&]{
+			// 4096 distinct paths, more than the cache holds.
+			return ToolBox::MacToUnix(mac_paths[mac_index++ & 4095]).size();
+		}},
+
+		{ "utf8_to_macroman/ascii", [&]{
+			return utf8_to_macroman(utf8_ascii).size();
+		}},
+		{ "utf8_to_macroman/mixed", [&]{
+			return utf8_to_macroman(utf8_mixed).size();
+		}},
+
+		{ "macroman_to_utf8/64k", [&]{
+			return macroman_to_utf8(text_mac).size();
+		}, text_mac.size() },
+		{ "utf8_to_macroman/64k", [&]{
+			return utf8_to_macroman(text_utf8).size();
+		}, text_utf8.size() },
+		{ "macroman_to_utf8/64k-buffer", [&]{
+			return macroman_to_utf8(text_mac.data(), text_mac.size(), text_buffer.data());
+		}, text_mac.size() },
+		{ "utf8_to_macroman/64k-buffer", [&]{
+			uint32_t state = 0;
+			return utf8_to_macroman(text_utf8.data(), text_utf8.size(), text_buffer.data(), state);
+		}, text_utf8.size() },
+
+		{ "transcode/pipe-1m", [&]{
+			// a tool writing 1MB of MacRoman text through {TranscodeOutput}.
+			int fd[2];
+			if (pipe(fd) < 0) return (size_t)0;
+			std::thread tool([&]{
+				const char *cp = tool_output.data();
+				size_t size = tool_output.size();
+				while (size) {
+					ssize_t n = write(fd[1], cp, size);
+					if (n <= 0) break;
+					cp += n;
+					size -= n;
+				}
+				close(fd[1]);
+			});
+			transcode_output(fd[0], null_fd, -1, -1);
+			tool.join();
+			close(fd[0]);
+			return (size_t)1;
+		}, tool_output.size() },
+
+		{ "mpw_regex/glob", [&]{
+			return (size_t)glob.match("file123.c.o") + glob.match("file123.c");
+		}},
+		{ "mpw_regex/capture", [&]{
+			return (size_t)re.match(":Sources:Lib:file.c", env);
+		}},
+
+		{ "expression", [&]{
+			std::string s = expand_vars(expr, env, null_fds);
+			return (size_t)evaluate_expression(env, "Evaluate", tokenize(s, true));
+		}},
+
+		{ "mpw_parser/64", [&]{
+			env.set("objects", "a.c.o");
+			mpw_parser p(env, null_fds);
+			p.parse(script_small);
+			p.finish();
+			return (size_t)env.status();
+		}},
+		{ "mpw_parser/4096", [&]{
+			env.set("objects", "a.c.o");
+			mpw_parser p(env, null_fds);
+			p.parse(script_large);
+			p.finish();
+			return (size_t)env.status();
+		}},
+
+		{ "set/self-append-5k", [&]{
+			mpw_parser p(env, null_fds);
+			p.parse(script_list_5k);
+			p.finish();
+			return env.get("objects").size();
+		}},
+		{ "set/rebuild-5k", [&]{
+			mpw_parser p(env, null_fds);
+			p.parse(script_list_5k_slow);
+			p.finish();
+			return env.get("objects").size();
+		}},
+		{ "set/self-append-50k", [&]{
+			mpw_parser p(env, null_fds);
+			p.parse(script_list_50k);
+			p.finish();
+			return env.get("objects").size();
+		}},
+
+		{ "redirect/append-16", [&]{
+			return append_16(append);
+		}},
+		{ "redirect/append-16-cached", [&]{
+			// as inside a loop.
+			fd_cache::scope cache;
+			return append_16(append);
+		}},
+		{ "mpw_parser/log-loop", [&]{
+			if (ftruncate(log.fd, 0) < 0) return (size_t)0;
+			mpw_parser p(env, null_fds);
+			p.parse(script_log);
+			p.finish();
+			return (size_t)env.status();
+		}},
+	};
+
+	if (list) {
+		for (const auto &b : benchmarks) printf("%s\n", b.name);
+		return 0;
+	}
+
+	FILE *fp = stdout;
+	if (!output.empty()) {
+		fp = fopen(output.c_str(), "w");
+		if (!fp) {
+			fprintf(stderr, "### mpw-shell-bench - Unable to open \"%s\".\n", output.c_str());
+			return 1;
+		}
+	}
+
+	if (parse_lines > 0) {
+		int rv = parse_large(env, null_fds, std::max(parse_lines, 2), fp);
+		echo_flush();
+		if (fp != stdout) fclose(fp);
+		return rv;
+	}
+
+	std::vector<result> results;
+	for (const auto &b : benchmarks) {
+		if (argc) {
+			bool ok = false;
+			for (int i = 0; i < argc; ++i) {
+				if (strstr(b.name, argv[i])) { ok = true; break; }
+			}
+			if (!ok) continue;
+		}
+		results.emplace_back(run(b));
+		const auto &r = results.back();
+		fprintf(stderr, "%-30s %12.1f ns/op  (min %.1f, max %.1f, %llu iterations)\n",
+			r.name.c_str(), r.ns_per_op, r.min_ns_per_op, r.max_ns_per_op,
+			(unsigned long long)r.iterations);
+	}
+	echo_flush();
+
+	write_json(fp, results);
+	if (fp != stdout) fclose(fp);
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * stub mpw emulator for benchmarking the shell.
+ *
+ * mpw --shell tool [args...]
+ *     Make prints a synthetic build script; anything else pretends to be
+ *     a compiler/linker: it sleeps, writes any -o output and exits.
+ *
+ * mpw --generate count [--sh]
+ *     print a synthetic Make script with count commands.  --sh prints the
+ *     equivalent /bin/sh script (running the stub directly) as a baseline.
+ *
+ * environment:
+ *     MPW_STUB_SLEEP    microseconds each tool sleeps (default 0)
+ *     MPW_STUB_STATUS   exit status for tools (default 0)
+ *     MPW_STUB_FAIL     tool name which exits with status 1
+ *     MPW_STUB_COUNT    number of commands Make generates (default 1000)
+ *     MPW_STUB_OUTPUT   0 to skip writing -o files
+ */
+
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+namespace {
+
+	long env_number(const char *name, long default_value) {
+		const char *cp = getenv(name);
+		if (!cp || !*cp) return default_value;
+		return strtol(cp, nullptr, 10);
+	}
+
+	std::string basename(const std::string &s) {
+		auto pos = s.find_last_of("/:");
+		if (pos == s.npos) return s;
+		return s.substr(pos + 1);
+	}
+
+	// :obj:file.c.o -> obj/file.c.o, Volume:file -> /Volume/file
+	std::string unix_path(const std::string &s) {
+		if (s.find(':') == s.npos) return s;
+		std::string rv;
+		auto iter = s.begin();
+		if (*iter == ':') ++iter;
+		else rv.push_back('/');
+		for (; iter != s.end(); ++iter) {
+			if (*iter == ':') {
+				if (iter + 1 != s.end() && iter[1] == ':') rv.append("../");
+				else rv.push_back('/');
+			}
+			else rv.push_back(*iter);
+		}
+		return rv;
+	}
+
+	void generate(FILE *fp, long count, bool sh) {
+
+		const char *stub = sh ? "\"$MPW_STUB\" --shell" : "";
+		long objects = 0;
+
+		if (sh) fputs("#!/bin/sh\nset -e\n", fp);
+
+		for (long i = 0; i < count; ++i) {
+			if (i % 16 == 15) {
+				// link everything compiled so far.
+				if (sh) fprintf(fp, "%s Link -w -c 'MPS ' -t MPST -o obj/Tool%ld", stub, i);
+				else fprintf(fp, "Link -w -c 'MPS ' -t MPST -o :obj:Tool%ld \xb6\n\t", i);
+				for (long j = objects; j < i; ++j) {
+					if (sh) fprintf(fp, " obj/file%ld.c.o", j);
+					else fprintf(fp, " :obj:file%ld.c.o", j);
+				}
+				if (sh) fputs(" \"$MPW_LIBRARIES/Stubs.o\"\n", fp);
+				else fputs(" \"{Libraries}\"Stubs.o\n", fp);
+				objects = i + 1;
+				continue;
+			}
+			if (i % 16 == 14) {
+				if (sh) fprintf(fp, "%s Rez -a -o obj/Tool%ld Types.r\n", stub, i + 1);
+				else fprintf(fp, "Rez -a -o :obj:Tool%ld Types.r\n", i + 1);
+				continue;
+			}
+			if (sh) fprintf(fp, "%s SC -w 17 -opt speed -d DEBUG=1 -i Includes -o obj/file%ld.c.o file%ld.c\n",
+				stub, i, i);
+			else fprintf(fp, "SC {SCOptions} -w 17 -opt speed -d DEBUG={Debug} -i :Includes: -o :obj:file%ld.c.o file%ld.c\n",
+				i, i);
+		}
+	}
+
+	int tool(int argc, char **argv) {
+
+		std::string name = basename(argv[0]);
+
+		if (!strcasecmp(name.c_str(), "Make")) {
+			generate(stdout, env_number("MPW_STUB_COUNT", 1000), false);
+			return 0;
+		}
+
+		long us = env_number("MPW_STUB_SLEEP", 0);
+		if (us > 0) usleep(us);
+
+		const char *fail = getenv("MPW_STUB_FAIL");
+		if (fail && !strcasecmp(fail, name.c_str())) return 1;
+
+		if (env_number("MPW_STUB_OUTPUT", 1)) {
+			for (int i = 1; i < argc - 1; ++i) {
+				if (strcmp(argv[i], "-o")) continue;
+				std::string path = unix_path(argv[i + 1]);
+				int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+				if (fd >= 0) {
+					write(fd, name.data(), name.size());
+					close(fd);
+				}
+			}
+		}
+
+		return env_number("MPW_STUB_STATUS", 0);
+	}
+
+	void usage() {
+		fputs("Usage: mpw --shell tool [args...]\n", stderr);
+		fputs("       mpw --generate count [--sh]\n", stderr);
+	}
+}
+
+int main(int argc, char **argv) {
+
+	if (argc >= 3 && !strcmp(argv[1], "--shell"))
+		return tool(argc - 2, argv + 2);
+
+	if (argc >= 3 && !strcmp(argv[1], "--generate")) {
+		bool sh = argc >= 4 && !strcmp(argv[3], "--sh");
+		generate(stdout, strtol(argv[2], nullptr, 10), sh);
+		return 0;
+	}
+
+	usage();
+	return EX_USAGE;
+}
@@ -0,0 +1,105 @@
+#!/bin/sh
+#
+# mpw-make --watch latency: from touching a source to the rebuild starting.
+#
+# watch-latency.sh [-n changes] [-f files] [-d delay-ms] [build-dir]
+#
+# builds a throwaway MPW root ($HOME/mpw with a Startup file) and a makefile
+# with -f sources (built with Echo, so no emulator is needed), starts
+# mpw-make --native --watch, then touches one source at a time and waits
+# for the "rebuilding" line.  event_ms is what mpw-make reports (first
+# change to build start, including the {MakeWatchDelay} quiet period);
+# total_ms also includes inotify delivery and this script's polling.
+# results are printed as json (averages over -n changes).
+#
+
+set -e
+
+changes=20
+files=100
+delay=20
+
+while getopts "n:f:d:" opt; do
+	case $opt in
+		n) changes=$OPTARG ;;
+		f) files=$OPTARG ;;
+		d) delay=$OPTARG ;;
+		*) echo "Usage: $0 [-n changes] [-f files] [-d delay-ms] [build-dir]" >&2; exit 64 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+build=$(cd "${1:-.}" && pwd)
+shell="$build/mpw-shell"
+
+if [ ! -x "$shell" ]; then
+	echo "### $0 - $shell not found" >&2
+	exit 1
+fi
+
+tmp=$(mktemp -d)
+pid=
+trap '[ -n "$pid" ] && kill $pid 2>/dev/null; rm -rf "$tmp"' EXIT
+
+mkdir -p "$tmp/mpw" "$tmp/work/obj"
+echo "Set -e MakeWatchDelay $delay" > "$tmp/mpw/Startup"
+
+cd "$tmp/work"
+
+# all ƒ obj/s0.o ...  then one rule per source.
+printf 'all \304' > MakeFile
+i=0
+while [ $i -lt "$files" ]; do
+	printf ' obj/s%d.o' $i >> MakeFile
+	i=$((i + 1))
+done
+echo >> MakeFile
+i=0
+while [ $i -lt "$files" ]; do
+	echo "x" > "s$i.c"
+	printf 'obj/s%d.o \304 s%d.c\n\tEcho built > obj/s%d.o\n' $i $i $i >> MakeFile
+	i=$((i + 1))
+done
+
+HOME=$tmp
+export HOME
+
+now() {
+	date +%s%N
+}
+
+# number of lines in the log matching $1.
+count() {
+	grep -c "$1" log || true
+}
+
+"$shell" make --native --watch > /dev/null 2> log &
+pid=$!
+
+while [ "$(count watching)" -lt 1 ]; do sleep 0.01; done
+
+total=0
+i=0
+while [ $i -lt "$changes" ]; do
+	n=$(count rebuilding)
+	start=$(now)
+	echo "y" >> "s$((i % files)).c"
+	while [ "$(count rebuilding)" -le "$n" ]; do sleep 0.001; done
+	end=$(now)
+	total=$((total + end - start))
+	# let the build finish before the next change.
+	while [ "$(count watching)" -le $((n + 1)) ]; do sleep 0.01; done
+	i=$((i + 1))
+done
+
+event=$(sed -n 's/.*rebuilding (\([0-9.]*\) ms.*/\1/p' log | awk '{ s += $1 } END { if (NR) printf "%.2f", s / NR; else print 0 }')
+
+cat <<EOF
+{
+  "files": $files,
+  "changes": $changes,
+  "delay_ms": $delay,
+  "event_ms": $event,
+  "total_ms": $((total / 1000000 / changes))
+}
+EOF
@@ -0,0 +1,304 @@
+#include "build_export.h"
+#include "environment.h"
+#include "fdset.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cxx/filesystem.h"
+
+namespace fs = filesystem;
+
+namespace ToolBox {
+	std::string MacToUnix(const std::string path);
+}
+
+fs::path mpw_path();
+
+build_export *build_export::_active = nullptr;
+
+namespace {
+
+	std::string absolute(const std::string &cwd, const std::string &path) {
+		if (!path.empty() && path.front() == '/') return path;
+		return cwd + "/" + path;
+	}
+
+	std::string sh_quote(const std::string &s) {
+		if (!s.empty() && s.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-+=./:,@%") == std::string::npos)
+			return s;
+		std::string rv = "'";
+		for (char c : s) {
+			if (c == '\'') rv += "'\\''";
+			else rv.push_back(c);
+		}
+		rv.push_back('\'');
+		return rv;
+	}
+
+	// ninja paths on a build line.
+	std::string ninja_path(const std::string &s) {
+		std::string rv;
+		for (char c : s) {
+			if (c == '$' || c == ' ' || c == ':') rv.push_back('$');
+			rv.push_back(c);
+		}
+		return rv;
+	}
+
+	// ninja variable values.
+	std::string ninja_value(const std::string &s) {
+		std::string rv;
+		for (char c : s) {
+			if (c == '$') rv.push_back('$');
+			if (c == '\n') { rv += "$\n"; continue; }
+			rv.push_back(c);
+		}
+		return rv;
+	}
+
+	std::string json_string(const std::string &s) {
+		std::string rv = "\"";
+		for (unsigned char c : s) {
+			switch (c) {
+				case '"': rv += "\\\""; break;
+				case '\\': rv += "\\\\"; break;
+				case '\n': rv += "\\n"; break;
+				case '\r': rv += "\\r"; break;
+				case '\t': rv += "\\t"; break;
+				default:
+					if (c < 0x20) {
+						char buffer[8];
+						snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+						rv += buffer;
+					}
+					else rv.push_back(c);
+			}
+		}
+		rv.push_back('"');
+		return rv;
+	}
+
+	bool is_file(const std::string &path) {
+		struct stat st;
+		return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+	}
+
+	bool is_source(const std::string &path) {
+		size_t pos = path.rfind('.');
+		if (pos == std::string::npos) return false;
+		for (const char *ext : { ".c", ".cp", ".cpp", ".cc" })
+			if (!strcasecmp(path.c_str() + pos, ext)) return true;
+		return false;
+	}
+
+	bool write_file(const std::string &path, const std::string &data) {
+		FILE *fp = fopen(path.c_str(), "w");
+		if (!fp) {
+			fprintf(stderr, "### MPW Shell - Unable to open %s: %s\n", path.c_str(), strerror(errno));
+			return false;
+		}
+		bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+		ok = (fclose(fp) == 0) && ok;
+		return ok;
+	}
+
+}
+
+
+build_export::build_export() {
+	_active = this;
+}
+
+build_export::~build_export() {
+	if (_active == this) _active = nullptr;
+}
+
+
+void build_export::add(const Environment &env, const process &p) {
+
+	command c;
+
+	char cwd[PATH_MAX];
+	if (!getcwd(cwd, sizeof(cwd))) cwd[0] = 0;
+	c.directory = cwd;
+	c.argv = p.arguments;
+
+	// exported variables, the way launch_mpw passes them.
+	for (const auto &kv : env) {
+		if (!kv.second) continue;
+		if (!c.environment.empty()) c.environment.push_back(' ');
+		c.environment += sh_quote("mpw$" + kv.first + "=" + (const std::string &)kv.second);
+	}
+
+	std::set<std::string> outputs;
+	bool append = false;
+	for (size_t i = 1; i < p.arguments.size(); ++i) {
+		if (p.arguments[i] == "-a") append = true;
+		if (p.arguments[i] == "-o" && i + 1 < p.arguments.size()) {
+			std::string path = absolute(cwd, ToolBox::MacToUnix(p.arguments[++i]));
+			struct stat st;
+			// -o :obj: -- the names aren't known.
+			if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) continue;
+			outputs.insert(path);
+			c.outputs.push_back(path);
+		}
+	}
+
+	for (const auto &r : p.redirections) {
+		std::string path = absolute(cwd, ToolBox::MacToUnix(r.name));
+		std::string op;
+		if (r.fds == redirection::input) {
+			op = "<";
+			c.inputs.push_back(path);
+		}
+		else {
+			if (r.fds == redirection::output) op = r.append ? ">>" : ">";
+			if (r.fds == redirection::error) op = r.append ? "2>>" : "2>";
+			if (r.fds == (redirection::output | redirection::error)) op = r.append ? ">>" : ">";
+			if (r.append) c.inputs.push_back(path);
+			outputs.insert(path);
+			c.outputs.push_back(path);
+		}
+		if (!c.redirect.empty()) c.redirect.push_back(' ');
+		c.redirect += op + " " + sh_quote(path);
+		if (r.fds == (redirection::output | redirection::error)) c.redirect += " 2>&1";
+	}
+
+	for (size_t i = 1; i < p.arguments.size(); ++i) {
+		const std::string &s = p.arguments[i];
+		if (s.empty() || s.front() == '-') continue;
+		std::string path = absolute(cwd, ToolBox::MacToUnix(s));
+		// an output is only read when appending.
+		if (outputs.count(path) && !append) continue;
+		if (_outputs.count(path) || is_file(path)) c.inputs.push_back(path);
+	}
+
+	// a second writer (Rez -a -o app) can't share the output.
+	for (const auto &o : c.outputs) {
+		if (_outputs.count(o)) c.stamp = true;
+	}
+	if (c.outputs.empty()) c.stamp = true;
+	if (!c.stamp) _outputs.insert(c.outputs.begin(), c.outputs.end());
+
+	// anything last written by a stamped command (SetFile after Rez -a)
+	// waits for that command, not just the file's first writer.
+	for (const auto *v : { &c.inputs, &c.outputs }) {
+		for (const auto &path : *v) {
+			auto iter = _stamped.find(path);
+			if (iter != _stamped.end()) c.after.insert(iter->second);
+		}
+	}
+	for (const auto &o : c.outputs) {
+		if (c.stamp) _stamped[o] = _commands.size();
+		else _stamped.erase(o);
+	}
+
+	_commands.push_back(std::move(c));
+}
+
+
+bool build_export::write(const std::string &dir) const {
+
+	mkdir(dir.c_str(), 0777);
+
+	char cwd[PATH_MAX];
+	if (!getcwd(cwd, sizeof(cwd))) cwd[0] = 0;
+	std::string root = absolute(cwd, dir);
+
+	std::string ninja;
+	ninja += "# generated by mpw-make --export\n";
+	ninja += "ninja_required_version = 1.3\n";
+	ninja += "mpw = " + ninja_value(sh_quote(mpw_path().string())) + "\n";
+	std::string env = _commands.empty() ? "" : _commands.front().environment;
+	ninja += "mpwenv = " + ninja_value(env) + "\n\n";
+
+	ninja += "rule mpw\n";
+	ninja += "  command = cd $dir && env $mpwenv $mpw --shell $args $redirect\n";
+	ninja += "  description = $desc\n";
+	ninja += "  restat = 1\n\n";
+
+	ninja += "rule mpw_stamp\n";
+	ninja += "  command = cd $dir && env $mpwenv $mpw --shell $args $redirect && touch $out\n";
+	ninja += "  description = $desc\n\n";
+
+	std::vector<std::string> all;
+	std::string json = "[\n";
+	bool first = true;
+
+	for (size_t i = 0; i < _commands.size(); ++i) {
+		const command &c = _commands[i];
+
+		std::vector<std::string> outputs = c.outputs;
+		if (c.stamp) outputs = { root + "/stamp/" + std::to_string(i) };
+
+		// stamps keep commands in script order relative to the outputs they share.
+		std::vector<std::string> order;
+		if (c.stamp) {
+			for (const auto &o : c.outputs) {
+				if (_outputs.count(o)) order.push_back(o);
+			}
+		}
+
+		std::string args;
+		std::string desc;
+		for (const auto &a : c.argv) {
+			if (!args.empty()) { args.push_back(' '); desc.push_back(' '); }
+			args += sh_quote(a);
+			desc += a;
+		}
+
+		ninja += "build";
+		for (const auto &o : outputs) ninja += " " + ninja_path(o);
+		ninja += ": " + std::string(c.stamp ? "mpw_stamp" : "mpw");
+		for (const auto &in : c.inputs) ninja += " " + ninja_path(in);
+		if (!c.after.empty()) {
+			ninja += " |";
+			for (size_t j : c.after) ninja += " " + ninja_path(root + "/stamp/" + std::to_string(j));
+		}
+		if (!order.empty()) {
+			ninja += " ||";
+			for (const auto &o : order) ninja += " " + ninja_path(o);
+		}
+		ninja += "\n";
+		ninja += "  dir = " + ninja_value(sh_quote(c.directory)) + "\n";
+		ninja += "  args = " + ninja_value(args) + "\n";
+		if (!c.redirect.empty()) ninja += "  redirect = " + ninja_value(c.redirect) + "\n";
+		if (c.environment != env) ninja += "  mpwenv = " + ninja_value(c.environment) + "\n";
+		ninja += "  desc = " + ninja_value(desc) + "\n\n";
+		all.insert(all.end(), outputs.begin(), outputs.end());
+
+		// compile_commands.json -- compiles are commands whose first input is c source.
+		if (!c.inputs.empty() && is_source(c.inputs.front())) {
+			const std::string &in = c.inputs.front();
+			if (!first) json += ",\n";
+			first = false;
+			json += "  {\n";
+			json += "    \"directory\": " + json_string(c.directory) + ",\n";
+			json += "    \"arguments\": [";
+			for (size_t j = 0; j < c.argv.size(); ++j) {
+				if (j) json += ", ";
+				json += json_string(c.argv[j]);
+			}
+			json += "],\n";
+			json += "    \"file\": " + json_string(in);
+			if (!c.outputs.empty()) json += ",\n    \"output\": " + json_string(c.outputs.front());
+			json += "\n  }";
+		}
+	}
+	json += "\n]\n";
+
+	ninja += "build all: phony";
+	for (const auto &o : all) ninja += " " + ninja_path(o);
+	ninja += "\ndefault all\n";
+
+	mkdir((root + "/stamp").c_str(), 0777);
+	return write_file(root + "/build.ninja", ninja) && write_file(root + "/compile_commands.json", json);
+}
@@ -0,0 +1,66 @@
+#ifndef __build_export_h__
+#define __build_export_h__
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class Environment;
+struct process;
+
+/*
+ * records external commands instead of running them, then writes them out
+ * as build.ninja and compile_commands.json (mpw-make --export dir).
+ *
+ * while an exporter exists, simple_command hands it every external command
+ * (after variable expansion and redirection parsing).  builtins still run.
+ *
+ * inputs and outputs come from the arguments: -o names an output, any other
+ * argument naming an existing file (or an earlier output) is an input, and
+ * redirections are inputs or outputs.  commands with no known output (or
+ * one that an earlier command already writes, like Rez -a) get a stamp
+ * file.  later commands that read or write that output depend on the
+ * stamp, so they run after the last writer, not just the first.
+ */
+class build_export {
+
+public:
+
+	build_export();
+	~build_export();
+
+	build_export(const build_export &) = delete;
+	build_export &operator=(const build_export &) = delete;
+
+	static build_export *active() noexcept { return _active; }
+
+	// p.arguments[0] is the resolved tool path.
+	void add(const Environment &env, const process &p);
+
+	// returns false (after printing an error) if the files can't be written.
+	bool write(const std::string &dir) const;
+
+	size_t size() const noexcept { return _commands.size(); }
+
+private:
+
+	struct command {
+		std::string directory;
+		std::vector<std::string> argv;
+		std::vector<std::string> inputs;
+		std::vector<std::string> outputs;
+		std::string redirect; // sh syntax
+		std::string environment;
+		std::set<size_t> after; // stamps of earlier writers
+		bool stamp = false;
+	};
+
+	std::vector<command> _commands;
+	std::set<std::string> _outputs;
+	std::map<std::string, size_t> _stamped; // path -> last writer, if a stamp
+
+	static build_export *_active;
+};
+
+#endif
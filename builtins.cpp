@@ -5,12 +5,18 @@
 #include "value.h"
 #include "environment.h"
 #include "error.h"
+#include "echo_buffer.h"
+#include "tool_cache.h"
+#include "include_scanner.h"
+#include "alloc_stats.h"
 
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include <thread>
 
+#include <cerrno>
 #include <cstdio>
 #include <cctype>
 #include <cstring>
@@ -117,24 +123,38 @@ namespace {
 #define fputs DO_NOT_USE_FPUTS
 #define fputc DO_NOT_USE_FPUTC
 
+// pending {Echo} output needs to be written first.
+inline ssize_t fdwrite(int fd, const void *data, size_t size) {
+	if (fd == STDOUT_FILENO || fd == STDERR_FILENO) echo_flush();
+	return write(fd, data, size);
+}
+
 inline int fdputs(const char *data, int fd) {
-	auto rv = write(fd, data, strlen(data));
+	auto rv = fdwrite(fd, data, strlen(data));
 	return rv < 0 ? EOF : rv;
 }
 
 inline int fdputs(const std::string &s, int fd) {
-	auto rv = write(fd, s.data(), s.size());
+	auto rv = fdwrite(fd, s.data(), s.size());
 	return rv < 0 ? EOF : rv;
 }
 
 inline int fdputc(int c, int fd) {
 	unsigned char tmp = c;
-	auto rv = write(fd, &tmp, 1);
+	auto rv = fdwrite(fd, &tmp, 1);
 	return rv < 0 ? EOF : c;
 }
 
 #ifdef HAVE_DPRINTF
-#define fdprintf dprintf
+inline int fdprintf(int fd, const char *format, ...) {
+	va_list ap;
+
+	if (fd == STDOUT_FILENO || fd == STDERR_FILENO) echo_flush();
+	va_start(ap, format);
+	int len = vdprintf(fd, format, ap);
+	va_end(ap);
+	return len;
+}
 #else
 inline int fdprintf(int fd, const char *format, ...) {
 	char *cp = nullptr;
@@ -872,7 +892,7 @@ int builtin_which(Environment &env, const std::vector<std::string> &tokens, cons
 }
 
 int cat_helper(int in, int out) {
-	static uint8_t buffer[4096];
+	uint8_t buffer[4096];
 
 	for(;;) {
 		ssize_t rcount = read(in, buffer, sizeof(buffer));
@@ -884,7 +904,7 @@ int cat_helper(int in, int out) {
 		if (rcount == 0) break;
 
 		for (;;) {
-			ssize_t wcount = write(out, buffer, rcount);
+			ssize_t wcount = fdwrite(out, buffer, rcount);
 			if (wcount < 0) {
 				if (errno == EINTR) continue;
 				return 2;	
@@ -1059,6 +1079,193 @@ int builtin_quit(Environment &, const std::vector<std::string> &tokens, const fd
 }
 
 
+int builtin_scanincludes(Environment &env, const std::vector<std::string> &tokens, const fdmask &fds) {
+
+	// not in MPW.
+	// ScanIncludes [-o file] [-d dir] [-c cache] [-j jobs] [-s] [-p] file...
+	// writes a Make dependency rule (dir:file.o ƒ file includes...) per file.
+
+	std::string output;
+	std::string objects;
+	std::string cache;
+	unsigned jobs = std::thread::hardware_concurrency();
+	bool system = false;
+	bool progress = false;
+	bool error = false;
+	std::vector<std::string> files;
+
+	for (size_t i = 1; i < tokens.size(); ++i) {
+		std::string flag = tokens[i];
+		if (flag.size() < 2 || flag[0] != '-') {
+			files.push_back(ToolBox::MacToUnix(flag));
+			continue;
+		}
+		lowercase(flag);
+		if (flag == "-s") { system = true; continue; }
+		if (flag == "-p") { progress = true; continue; }
+		if (flag == "-o" || flag == "-d" || flag == "-c" || flag == "-j") {
+			if (++i == tokens.size()) {
+				fdprintf(stderr, "### ScanIncludes - Missing parameter for %s.\n", flag.c_str());
+				error = true;
+				break;
+			}
+			if (flag == "-o") output = tokens[i];
+			if (flag == "-d") objects = tokens[i];
+			if (flag == "-c") cache = ToolBox::MacToUnix(tokens[i]);
+			if (flag == "-j") jobs = strtoul(tokens[i].c_str(), nullptr, 10);
+			continue;
+		}
+		fdprintf(stderr, "### ScanIncludes - \"%s\" is not an option.\n", flag.c_str());
+		error = true;
+	}
+
+	if (files.empty() && !error) {
+		fdprintf(stderr, "### ScanIncludes - No files were specified.\n");
+		error = true;
+	}
+
+	if (error) {
+		fdprintf(stderr, "# Usage - ScanIncludes [-o file] [-d dir] [-c cache] [-j jobs] [-s] [-p] file...\n");
+		return 1;
+	}
+
+	if (!objects.empty() && objects.back() != ':') objects.push_back(':');
+
+	include_scanner scanner(env);
+	if (!cache.empty()) scanner.load_cache(cache);
+	auto deps = scanner.scan(files, jobs, system);
+	if (!cache.empty()) scanner.save_cache(cache);
+
+	std::string text;
+	for (size_t i = 0; i < files.size(); ++i) {
+		std::string source = ToolBox::UnixToMac(files[i]);
+		std::string name = source.substr(source.find_last_of(':') + 1);
+		text += quote(objects + name + ".o");
+		text += " \xc4 ";
+		text += quote(source);
+		for (const auto &d : deps[i]) {
+			text.push_back(' ');
+			text += quote(ToolBox::UnixToMac(d));
+		}
+		text.push_back('\n');
+	}
+
+	if (progress) {
+		fdprintf(stderr, "# ScanIncludes - %zu files parsed, %zu unchanged\n", scanner.parsed(), scanner.cached());
+	}
+
+	if (output.empty()) {
+		fdputs(text, stdout);
+		return 0;
+	}
+
+	int fd = open(ToolBox::MacToUnix(output).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) {
+		fdprintf(stderr, "### ScanIncludes - Unable to open %s: %s\n", output.c_str(), strerror(errno));
+		return 1;
+	}
+	ssize_t rv = write(fd, text.data(), text.size());
+	close(fd);
+	return rv == (ssize_t)text.size() ? 0 : 1;
+}
+
+int builtin_toolcache(Environment &env, const std::vector<std::string> &tokens, const fdmask &fds) {
+
+	// not in MPW.
+
+	bool error = false;
+	bool _c = false;
+	bool _z = false;
+
+	auto argv = getopt(tokens, [&](char c){
+		switch(tolower(c))
+		{
+			case 'c': _c = true; break;
+			case 'z': _z = true; break;
+
+			default:
+				fdprintf(stderr, "### ToolCache - \"-%c\" is not an option.\n", c);
+				error = true;
+				break;
+		}
+	});
+
+	if (argv.size() > 0) {
+		fdprintf(stderr, "### ToolCache - Too many parameters were specified.\n");
+		error = true;
+	}
+
+	if (error) {
+		fdprintf(stderr, "# Usage - ToolCache [-c | -z]\n");
+		return 1;
+	}
+
+	std::string dir = env.get("toolcache");
+	if (dir.empty()) {
+		fdprintf(stderr, "### ToolCache - {ToolCache} is not set.\n");
+		return 1;
+	}
+
+	if (_c || _z) {
+		tool_cache::clear(dir, !_c);
+		return 0;
+	}
+
+	tool_cache::statistics st;
+	tool_cache::read_statistics(dir, st);
+
+	uint64_t total = st.hits + st.misses;
+	fdprintf(stdout, "# Tool cache %s\n", dir.c_str());
+	fdprintf(stdout, "#   hits       %llu (%.1f%%)\n", (unsigned long long)st.hits, total ? 100.0 * st.hits / total : 0.0);
+	fdprintf(stdout, "#   misses     %llu\n", (unsigned long long)st.misses);
+	fdprintf(stdout, "#   stores     %llu\n", (unsigned long long)st.stores);
+	fdprintf(stdout, "#   evictions  %llu\n", (unsigned long long)st.evictions);
+	fdprintf(stdout, "#   size       %.1f MB\n", st.bytes / 1048576.0);
+	return 0;
+}
+
+
+int builtin_allocstats(Environment &env, const std::vector<std::string> &tokens, const fdmask &fds) {
+
+	// not in MPW.
+
+	bool error = false;
+	bool _r = false;
+
+	auto argv = getopt(tokens, [&](char c){
+		switch(tolower(c))
+		{
+			case 'r': _r = true; break;
+
+			default:
+				fdprintf(stderr, "### AllocStats - \"-%c\" is not an option.\n", c);
+				error = true;
+				break;
+		}
+	});
+
+	if (argv.size() > 0) {
+		fdprintf(stderr, "### AllocStats - Too many parameters were specified.\n");
+		error = true;
+	}
+
+	if (error) {
+		fdprintf(stderr, "# Usage - AllocStats [-r]\n");
+		return 1;
+	}
+
+	if (!alloc_stats_enabled) {
+		fdprintf(stderr, "### AllocStats - Built without MPW_SHELL_ALLOC_STATS.\n");
+		return 1;
+	}
+
+	// the report is of everything up to now; -r then starts over.
+	fdputs(alloc_stats_summary(), stdout);
+	if (_r) alloc_stats_reset();
+	return 0;
+}
+
+
 namespace {
 	template<class Iter>
 	Iter find_entry(Iter begin, Iter end) {
@@ -1105,7 +1312,7 @@ bool help_helper(const mapped_file &f, const fdmask &fds, const std::string &cmd
 
 	if (cmd.empty()) {
 		// print first entry
-		write(stdout, f.begin(), std::distance(f.begin(), iter));
+		fdwrite(stdout, f.begin(), std::distance(f.begin(), iter));
 		fdputs("\n", stdout);
 		return true;
 	}
@@ -1120,7 +1327,7 @@ bool help_helper(const mapped_file &f, const fdmask &fds, const std::string &cmd
  		auto l = std::distance(iter, end);
  		if (help_name_match(cmd.begin(), cmd.end(), iter, next)) {
 
-			write(stdout, iter, std::distance(iter, next));
+			fdwrite(stdout, iter, std::distance(iter, next));
 			fdputs("\n", stdout);
 
  			return true;
@@ -1202,7 +1409,7 @@ int builtin_help(Environment &env, const std::vector<std::string> &tokens, const
 		mapped_file f(p, mapped_file::priv, ec);
 		if (!ec) {
 			std::replace(f.begin(), f.end(), '\r', '\n');
-			write(stdout, f.data(), f.size());
+			fdwrite(stdout, f.data(), f.size());
 			fdputs("\n", stdout);
 			continue;
 		}
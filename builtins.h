@@ -30,6 +30,9 @@ int builtin_execute(Environment &e, const std::vector<std::string> &, const fdma
 int builtin_true(Environment &e, const std::vector<std::string> &, const fdmask &);
 int builtin_false(Environment &e, const std::vector<std::string> &, const fdmask &);
 int builtin_quit(Environment &e, const std::vector<std::string> &, const fdmask &);
+int builtin_scanincludes(Environment &e, const std::vector<std::string> &, const fdmask &);
+int builtin_toolcache(Environment &e, const std::vector<std::string> &, const fdmask &);
+int builtin_allocstats(Environment &e, const std::vector<std::string> &, const fdmask &);
 
 
 int builtin_evaluate(Environment &e, std::vector<token> &&, const fdmask &);
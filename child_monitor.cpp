@@ -0,0 +1,249 @@
+#include "child_monitor.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sysexits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#endif
+
+namespace {
+
+	int64_t now() {
+		auto d = std::chrono::steady_clock::now().time_since_epoch();
+		return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+	}
+
+}
+
+
+child_monitor::child_monitor() {
+
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGQUIT);
+	pthread_sigmask(SIG_BLOCK, &mask, &_old_mask);
+
+	sigaction(SIGINT, nullptr, &_old_int);
+	sigaction(SIGQUIT, nullptr, &_old_quit);
+
+#if defined(__linux__)
+	sigdelset(&mask, SIGCHLD);
+	_epoll = epoll_create1(EPOLL_CLOEXEC);
+	_signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (_epoll >= 0 && _signal_fd >= 0) {
+		struct epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = _signal_fd;
+		if (epoll_ctl(_epoll, EPOLL_CTL_ADD, _signal_fd, &ev) == 0) return;
+	}
+#endif
+
+	_fallback = true;
+}
+
+
+child_monitor::~child_monitor() {
+
+	for (auto &c : _children) {
+		if (c.fd >= 0) close(c.fd);
+	}
+
+#if defined(__linux__)
+	// consume anything still pending so it isn't delivered on unblock.
+	if (_signal_fd >= 0) {
+		struct signalfd_siginfo si;
+		while (read(_signal_fd, &si, sizeof(si)) == sizeof(si)) _interrupted = true;
+		close(_signal_fd);
+	}
+	if (_epoll >= 0) close(_epoll);
+#endif
+
+	if (_fallback) {
+		sigaction(SIGINT, &_old_int, nullptr);
+		sigaction(SIGQUIT, &_old_quit, nullptr);
+	}
+	pthread_sigmask(SIG_SETMASK, &_old_mask, nullptr);
+}
+
+
+void child_monitor::child_reset() const {
+	sigaction(SIGINT, &_old_int, nullptr);
+	sigaction(SIGQUIT, &_old_quit, nullptr);
+	pthread_sigmask(SIG_SETMASK, &_old_mask, nullptr);
+}
+
+
+void child_monitor::add(pid_t pid) {
+
+	child c = { pid, -1, now() };
+
+	if (!_fallback) {
+#if defined(__linux__)
+		c.fd = syscall(SYS_pidfd_open, pid, 0);
+		if (c.fd >= 0) {
+			struct epoll_event ev = {};
+			ev.events = EPOLLIN;
+			ev.data.fd = c.fd;
+			epoll_ctl(_epoll, EPOLL_CTL_ADD, c.fd, &ev);
+		}
+		else {
+			// ENOSYS, etc.  everything switches to wait4.
+			for (auto &c : _children) {
+				close(c.fd);
+				c.fd = -1;
+			}
+			_fallback = true;
+		}
+#endif
+	}
+
+	if (_fallback) {
+		// ignore int/quit while waiting on the child.
+		struct sigaction ign = {};
+		ign.sa_handler = SIG_IGN;
+		sigemptyset(&ign.sa_mask);
+		sigaction(SIGINT, &ign, nullptr);
+		sigaction(SIGQUIT, &ign, nullptr);
+	}
+
+	_children.push_back(c);
+}
+
+
+void child_monitor::remove(size_t index) {
+	child &c = _children[index];
+#if defined(__linux__)
+	if (c.fd >= 0) {
+		epoll_ctl(_epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+		close(c.fd);
+	}
+#endif
+	_children.erase(_children.begin() + index);
+}
+
+
+void child_monitor::kill(int signal) {
+	for (const auto &c : _children) ::kill(c.pid, signal);
+}
+
+
+// children in the shell's process group get ^C from the terminal.  one
+// that moved to its own group (setpgid/setsid) gets it from us.
+void child_monitor::forward(int signal) {
+	pid_t pgrp = getpgrp();
+	for (const auto &c : _children) {
+		pid_t pg = getpgid(c.pid);
+		if (pg > 0 && pg != pgrp) ::kill(-pg, signal);
+	}
+}
+
+
+/*
+ * only our own children are waited for -- wait4(-1) could reap one that
+ * belongs to another monitor (another shell thread), which would then wait
+ * forever.  anything already finished is returned first; otherwise this
+ * blocks on the oldest child.
+ */
+bool child_monitor::wait_fallback(event &e) {
+
+	for(;;) {
+		int status;
+		struct rusage ru;
+		size_t index = 0;
+		pid_t ok = 0;
+
+		for (index = 0; index < _children.size(); ++index) {
+			ok = wait4(_children[index].pid, &status, WNOHANG, &ru);
+			if (ok != 0) break;
+		}
+		if (ok == 0) {
+			index = 0;
+			ok = wait4(_children.front().pid, &status, 0, &ru);
+		}
+		if (ok < 0) {
+			if (errno == EINTR) continue;
+			perror("wait4: ");
+			exit(EX_OSERR);
+		}
+
+		e.pid = ok;
+		e.status = status;
+		e.ru = ru;
+		e.wall_time = now() - _children[index].begin;
+		remove(index);
+		return true;
+	}
+}
+
+
+bool child_monitor::wait(event &e) {
+
+	if (_children.empty()) return false;
+	if (_fallback) return wait_fallback(e);
+
+#if defined(__linux__)
+	for(;;) {
+		struct epoll_event events[8];
+		int n = epoll_wait(_epoll, events, 8, -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("epoll_wait: ");
+			exit(EX_OSERR);
+		}
+
+		for (int i = 0; i < n; ++i) {
+			int fd = events[i].data.fd;
+
+			if (fd == _signal_fd) {
+				struct signalfd_siginfo si;
+				while (read(_signal_fd, &si, sizeof(si)) == sizeof(si)) {
+					_interrupted = true;
+					forward(si.ssi_signo);
+				}
+				continue;
+			}
+
+			auto iter = std::find_if(_children.begin(), _children.end(), [fd](const child &c){
+				return c.fd == fd;
+			});
+			if (iter == _children.end()) continue;
+
+			int status;
+			struct rusage ru;
+			pid_t ok = wait4(iter->pid, &status, WNOHANG, &ru);
+			if (ok == 0) continue;
+			if (ok < 0) {
+				if (errno == EINTR) continue;
+				perror("wait4: ");
+				exit(EX_OSERR);
+			}
+
+			e.pid = ok;
+			e.status = status;
+			e.ru = ru;
+			e.wall_time = now() - iter->begin;
+			remove(iter - _children.begin());
+			return true;
+		}
+	}
+#endif
+	return false;
+}
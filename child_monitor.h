@@ -0,0 +1,81 @@
+#ifndef __child_monitor_h__
+#define __child_monitor_h__
+
+#include <cstdint>
+#include <vector>
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/*
+ * waits for any number of child processes.
+ *
+ * on linux, each child is a pidfd and SIGINT/SIGQUIT are read through a
+ * signalfd, all in one epoll set.  elsewhere (or if pidfd_open isn't
+ * available) it falls back to a blocking wait4 with SIGINT/SIGQUIT ignored,
+ * which is what execute_external always did.
+ *
+ * while a monitor exists, SIGCHLD, SIGINT and SIGQUIT are blocked in the
+ * calling thread (other threads must keep them blocked, too -- see
+ * echo_buffer.cpp).  interrupts are noted (interrupted()) and forwarded to
+ * children running in their own process group (children in the shell's
+ * process group get them from the terminal).
+ */
+class child_monitor {
+
+public:
+
+	struct event {
+		pid_t pid = -1;
+		int status = 0;
+		struct rusage ru = {};
+		int64_t wall_time = 0; // microseconds
+	};
+
+	child_monitor();
+	~child_monitor();
+
+	child_monitor(const child_monitor &) = delete;
+	child_monitor &operator=(const child_monitor &) = delete;
+
+	void add(pid_t pid);
+
+	// wait for the next child to exit.  returns false if there are none.
+	bool wait(event &e);
+
+	// send a signal to every child.
+	void kill(int signal);
+
+	size_t size() const noexcept { return _children.size(); }
+
+	// a SIGINT or SIGQUIT arrived while waiting.
+	bool interrupted() const noexcept { return _interrupted; }
+
+	// call in a forked child to undo the signal changes.
+	void child_reset() const;
+
+private:
+
+	struct child {
+		pid_t pid;
+		int fd;
+		int64_t begin;
+	};
+
+	void forward(int signal);
+	bool wait_fallback(event &e);
+	void remove(size_t index);
+
+	std::vector<child> _children;
+	int _epoll = -1;
+	int _signal_fd = -1;
+	bool _fallback = false;
+	bool _interrupted = false;
+
+	sigset_t _old_mask;
+	struct sigaction _old_int;
+	struct sigaction _old_quit;
+};
+
+#endif
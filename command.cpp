@@ -6,6 +6,16 @@
 #include "mpw-shell.h"
 #include "error.h"
 #include "value.h"
+#include "echo_buffer.h"
+#include "profile.h"
+#include "alloc_stats.h"
+#include "resource_usage.h"
+#include "transcode.h"
+#include "parallel.h"
+#include "child_monitor.h"
+#include "tool_cache.h"
+#include "build_export.h"
+#include "fd_cache.h"
 
 #include <stdexcept>
 #include <unordered_map>
@@ -21,7 +31,9 @@
 
 #include <strings.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <sysexits.h>
 #include <signal.h>
 #include <atomic>
@@ -32,8 +44,6 @@
 #include <sys/xattr.h>
 #endif
 
-extern std::atomic<int> control_c;
-
 namespace fs = filesystem;
 extern fs::path mpw_path();
 
@@ -58,12 +68,14 @@ namespace {
 	 */
 
 	int bad_if(const char *name) {
+		echo_flush();
 		fprintf(stderr, "### %s - Missing if keyword.\n", name);
 		fprintf(stderr, "# Usage - %s [if expression...]\n", name);
 		return -3;
 	}
 
 	int bad_exit() {
+		echo_flush();
 		fprintf(stderr, "### Exit - Missing if keyword.\n");
 		fprintf(stderr, "# Usage - Exit [Number] [if expression...]\n");
 		return -3;
@@ -104,6 +116,7 @@ namespace {
 					e = evaluate_expression(env, "If", std::move(tokens));
 				}
 				catch (std::exception &ex) {
+					echo_flush();
 					fprintf(stderr, "%s\n", ex.what());
 					return -5;
 				}
@@ -143,6 +156,7 @@ namespace {
 
 
 fs::path which(const Environment &env, const std::string &name) {
+	profile_span span("which", name);
 	std::error_code ec;
 
 	if (name.find_first_of("/:") != name.npos) {
@@ -229,6 +243,7 @@ namespace {
 	std::unordered_map<std::string, int (*)(Environment &, const std::vector<std::string> &, const fdmask &)> builtins = {
 		{"aboutbox", builtin_aboutbox},
 		{"alias", builtin_alias},
+		{"allocstats", builtin_allocstats},
 		{"catenate", builtin_catenate},
 		{"directory", builtin_directory},
 		{"echo", builtin_echo},
@@ -239,8 +254,10 @@ namespace {
 		{"parameters", builtin_parameters},
 		{"quit", builtin_quit},
 		{"quote", builtin_quote},
+		{"scanincludes", builtin_scanincludes},
 		{"set", builtin_set},
 		{"shift", builtin_shift},
+		{"toolcache", builtin_toolcache},
 		{"unalias", builtin_unalias},
 		{"unexport", builtin_unexport},
 		{"unset", builtin_unset},
@@ -254,21 +271,54 @@ namespace {
 
 
 
-	int execute_external(const Environment &env, const std::vector<std::string> &argv, const fdmask &fds) {
+	int execute_external(const Environment &env, const std::vector<std::string> &argv, const fdmask &fds, resource_usage &usage) {
 
 		int status;
 		int pid;
 
-		struct sigaction ign, intact, quitact;
-		sigset_t newsigblock, oldsigblock;
+		// blocks int/quit/chld until the child has been reaped.
+		child_monitor monitor;
 
-		sigemptyset(&newsigblock);
-		sigaddset(&newsigblock, SIGCHLD);
-		sigaddset(&newsigblock, SIGINT);
-		sigaddset(&newsigblock, SIGQUIT);
-		sigprocmask(SIG_BLOCK, &newsigblock, &oldsigblock);
+		// when profiling, the pipe is closed by a successful execv.
+		int exec_pipe[2] = { -1, -1 };
+		uint64_t begin = 0;
+		if (profiling && pipe(exec_pipe) == 0) {
+			fcntl(exec_pipe[0], F_SETFD, FD_CLOEXEC);
+			fcntl(exec_pipe[1], F_SETFD, FD_CLOEXEC);
+			begin = profile_now();
+		}
 
+		// {TranscodeOutput} -- stdout and stderr go through pipes to be converted.
+		// files (> ≥ ∑) get the tool's bytes unchanged.
+		int out_pipe[2] = { -1, -1 };
+		int err_pipe[2] = { -1, -1 };
+		fdmask child_fds = fds;
+		if (env.transcode()) {
+			int out = fds[1];
+			int err = fds[2];
+			if (transcode_target(out)) {
+				if (pipe(out_pipe) < 0) {
+					perror("pipe: ");
+					exit(EX_OSERR);
+				}
+				out = out_pipe[1];
+			}
+			if (transcode_target(err)) {
+				if (pipe(err_pipe) < 0) {
+					perror("pipe: ");
+					exit(EX_OSERR);
+				}
+				err = err_pipe[1];
+			}
+			for (int fd : { out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1] })
+				if (fd >= 0) fcntl(fd, F_SETFD, FD_CLOEXEC);
+			child_fds = fdmask(fds[0], out, err);
+		}
 
+		// found before the fork, so the child never waits on another
+		// thread's first lookup.
+		mpw_path();
+		echo_flush();
 		pid = fork();
 		if (pid < 0) {
 			perror("fork: ");
@@ -276,32 +326,36 @@ namespace {
 		}
 
 		if (pid == 0) {
-			//sigprocmask(SIG_SETMASK, &oldsigblock, NULL);
-			launch_mpw(env, argv, fds);
+			monitor.child_reset();
+			launch_mpw(env, argv, child_fds);
+		}
+		monitor.add(pid);
+
+		if (exec_pipe[0] >= 0) {
+			char c;
+			close(exec_pipe[1]);
+			while (read(exec_pipe[0], &c, 1) < 0 && errno == EINTR) ;
+			close(exec_pipe[0]);
+			profile_event("launch", "fork/exec", begin, profile_now());
 		}
 
-		/* ignore int/quit while waiting on child */
-
-		memset(&ign, 0, sizeof(ign));
-		ign.sa_handler = SIG_IGN;
-		sigemptyset(&ign.sa_mask);
-		sigaction(SIGINT, &ign, &intact);
-		sigaction(SIGQUIT, &ign, &quitact);
-
-		for(;;) {
-			pid_t ok;
-			ok = waitpid(pid, &status, 0);
-			if (ok < 0) {
-				if (errno == EINTR) continue;
-				perror("waitpid:");
-				exit(EX_OSERR);
-			}
-			break;
+		if (out_pipe[0] >= 0 || err_pipe[0] >= 0) {
+			profile_span span("wait", "transcode");
+			for (int fd : { out_pipe[1], err_pipe[1] })
+				if (fd >= 0) close(fd);
+			transcode_output(out_pipe[0], fds[1], err_pipe[0], fds[2]);
+			for (int fd : { out_pipe[0], err_pipe[0] })
+				if (fd >= 0) close(fd);
 		}
 
-		sigaction(SIGINT, &intact, NULL);
-		sigaction(SIGQUIT,  &quitact, NULL);
-		sigprocmask(SIG_SETMASK, &oldsigblock, NULL);
+		profile_span span("wait", "waitpid");
+		child_monitor::event ev;
+		monitor.wait(ev);
+		status = ev.status;
+		usage = resource_usage(ev.ru, ev.wall_time);
+
+		// ^C while the tool ran stops the script, too.
+		if (monitor.interrupted()) env.control_c()++;
 
 		if (WIFEXITED(status)) {
 			return WEXITSTATUS(status);
@@ -336,7 +390,7 @@ int exec(std::string command, Environment &env, const fdmask &fds, bool throwup,
 	bool echo = true;
 	int rv = 0;
 
-	if (control_c) throw execution_of_input_terminated();
+	if (env.control_c()) throw execution_of_input_terminated();
 
 	try {
 		process p;
@@ -353,11 +407,13 @@ int exec(std::string command, Environment &env, const fdmask &fds, bool throwup,
 	}
 	catch (mpw_error &e) {
 		if (echo) env.echo("%s", command.c_str()); 
+		echo_flush();
 		fprintf(stderr, "### %s\n", e.what());
 		return env.status(e.status(), throwup);
 	}
 	catch (std::exception &e) {
 		if (echo) env.echo("%s", command.c_str()); 
+		echo_flush();
 		fprintf(stderr, "### %s\n", e.what());
 		return env.status(-4, throwup);
 	}
@@ -365,24 +421,83 @@ int exec(std::string command, Environment &env, const fdmask &fds, bool throwup,
 	return env.status(rv, throwup);
 }
 
+/*
+ * Set name "{name}..." appends to name in place rather than expanding the
+ * whole (growing) value and setting it again.  anything unusual -- a
+ * redirection, ∂, `...`, a comment -- goes the long way.
+ */
+static bool self_append(const std::string &s, Environment &env, const fdmask &fds) {
+
+	auto is_name = [](unsigned char c){ return isalnum(c) || c == '_'; };
+
+	size_t i = s.find_first_not_of(" \t");
+	if (i == s.npos || strncasecmp(s.c_str() + i, "set", 3)) return false;
+	i += 3;
+
+	size_t j = s.find_first_not_of(" \t", i);
+	if (j == i || j == s.npos) return false;
+	i = j;
+	while (j < s.size() && is_name(s[j])) ++j;
+	if (j == i) return false;
+	std::string name = s.substr(i, j - i);
+
+	i = s.find_first_not_of(" \t", j);
+	if (i == j || i == s.npos || s.compare(i, 2, "\"{")) return false;
+	i += 2;
+	if (s.size() - i <= name.size() || strncasecmp(s.c_str() + i, name.c_str(), name.size())) return false;
+	i += name.size();
+	if (s[i++] != '}') return false;
+
+	j = s.find('"', i);
+	if (j == s.npos || s.find_first_not_of(" \t\r\n", j + 1) != s.npos) return false;
+	std::string rest = s.substr(i, j - i);
+	if (rest.find_first_of("`\xb6") != rest.npos) return false;
+
+	profile_span span("builtin", "set");
+	alloc_stage stage(ALLOC_BUILTIN);
+	std::string suffix;
+	try {
+		// expanded as it would be inside the quotes.
+		suffix = expand_vars('"' + rest + '"', env, fds);
+	} catch (std::exception &) {
+		return false;
+	}
+	suffix = suffix.substr(1, suffix.size() - 2);
+	return env.append(name, suffix);
+}
+
 int simple_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 
+	alloc_command stats;
+
+	if (!env.echo() && !env.control_c() && self_append(text, env, fds)) {
+		stats.name("set");
+		env.set("command", "set");
+		return env.status(0, throwup);
+	}
 
 	return exec(text, env, fds, throwup, [&](process &p){
 
 		fdmask newfds = p.fds | fds;
 
+		profile_span span("command", p.arguments.front());
 		std::string name = p.arguments.front();
 		lowercase(name);
+		stats.name(name);
 
 		auto iter = builtins.find(name);
 		if (iter != builtins.end()) {
+			profile_span span("builtin", name);
+			alloc_stage stage(ALLOC_BUILTIN);
 			env.set("command", name);
 			int status = iter->second(env, p.arguments, newfds);
 			return status;
 		}
 
+		alloc_stage stage(ALLOC_LAUNCH);
+
 		if (env.startup()) {
+			echo_flush();
 			fprintf(stderr, "### MPW Shell - startup file may not contain external commands.\n");
 			return 0;
 		}
@@ -402,11 +517,19 @@ int simple_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 			new_env.set("command", path);
 			new_env.set_argv(p.arguments);
 
+			int rv;
 			try {
-				return read_file(new_env, path, newfds);
+				rv = read_file(new_env, path, newfds);
 			} catch (const exit_command_t &ex) {
-				return ex.value;
+				rv = ex.value;
+			}
+			// the script's totals count as one command here.
+			if (new_env.script_usage().commands) {
+				resource_usage ru = new_env.script_usage();
+				ru.commands = 1;
+				env.add_usage(ru);
 			}
+			return rv;
 		}
 
 
@@ -415,7 +538,25 @@ int simple_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 		env.set("command", path);
 		p.arguments[0] = path;
 
-		return execute_external(env, p.arguments, newfds);
+		// mpw-make --export -- record the command instead of running it.
+		if (auto *x = build_export::active()) {
+			x->add(env, p);
+			return 0;
+		}
+
+		// {ToolCache} -- on a hit the outputs are restored and nothing runs.
+		tool_cache cache(env, p.arguments, newfds);
+		if (cache.restore()) return 0;
+
+		resource_usage ru;
+		int status = execute_external(env, p.arguments, cache.fds(), ru);
+		cache.store(status);
+		env.add_usage(ru);
+
+		std::string log = env.get("resourcelog");
+		if (!log.empty()) log_resource_usage(ToolBox::MacToUnix(log), p.arguments, status, ru);
+
+		return status;
 	});
 }
 
@@ -426,7 +567,7 @@ int eval_exec(std::string command, Environment &env, const fdmask &fds, bool thr
 	bool echo = true;
 	int rv = 0;
 
-	if (control_c) throw execution_of_input_terminated();
+	if (env.control_c()) throw execution_of_input_terminated();
 
 	try {
 		command = expand_vars(command, env, fds);
@@ -446,6 +587,7 @@ int eval_exec(std::string command, Environment &env, const fdmask &fds, bool thr
 
 	catch (mpw_error &e) {
 		if (echo) env.echo("%s", command.c_str());
+		echo_flush();
 		fprintf(stderr, "### %s\n", e.what());
 		return env.status(e.status(), throwup);
 	}
@@ -453,6 +595,7 @@ int eval_exec(std::string command, Environment &env, const fdmask &fds, bool thr
 	catch(std::exception &e) {
 		// these should include the argv0 name.
 		if (echo) env.echo("%s", command.c_str());
+		echo_flush();
 		fprintf(stderr, "### %s - %s\n", name.c_str(), e.what());
 		return env.status(-4, throwup);	
 	}
@@ -600,9 +743,10 @@ int vector_command::execute(Environment &e, const fdmask &fds, bool throwup) {
 
 int error_command::execute(Environment &e, const fdmask &fds, bool throwup) {
 
-	if (control_c) throw execution_of_input_terminated();
+	if (e.control_c()) throw execution_of_input_terminated();
 
 	if (type == ERROR) {
+		echo_flush();
 		fprintf(stderr, "%s\n", text.c_str());
 		return e.status(-3);
 	}
@@ -610,6 +754,7 @@ int error_command::execute(Environment &e, const fdmask &fds, bool throwup) {
 	std::string s = expand_vars(text, e, fds);
 
 	e.echo("%s", s.c_str());
+	echo_flush();
 
 	switch(type) {
 	case END:
@@ -637,7 +782,7 @@ int begin_end_exec(std::string begin, std::string end, Environment &env, const f
 	bool echo = true;
 	int rv = 0;
 
-	if (control_c) throw execution_of_input_terminated();
+	if (env.control_c()) throw execution_of_input_terminated();
 
 	try {
 		process p;
@@ -659,11 +804,13 @@ int begin_end_exec(std::string begin, std::string end, Environment &env, const f
 	}
 	catch (mpw_error &e) {
 		if (echo) env.echo("%s ... %s", begin.c_str(), end.c_str() );
+		echo_flush();
 		fprintf(stderr, "### %s\n", e.what());
 		return env.status(e.status(), throwup);
 	}
 	catch (std::exception &e) {
 		if (echo) env.echo("%s ... %s", begin.c_str(), end.c_str() );
+		echo_flush();
 		fprintf(stderr, "### %s\n", e.what());
 		return env.status(-4, throwup);
 	}
@@ -677,6 +824,7 @@ int begin_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 
 		env.set("command", type == BEGIN ? "end" : ")");
 		if (b.size() != 1) {
+			echo_flush();
 			fprintf(stderr, "### Begin - Too many parameters were specified.\n");
 			fprintf(stderr, "Usage - Begin\n");
 			return -3;
@@ -696,12 +844,83 @@ int begin_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 }
 
 
+bool parallel_command::is_parallel(const std::string &s) {
+	auto is_space = [](unsigned char c){ return isspace(c); };
+	auto iter = std::find_if_not(s.begin(), s.end(), is_space);
+	if (s.end() - iter < 8 || strncasecmp(&*iter, "parallel", 8)) return false;
+	iter += 8;
+	return iter == s.end() || is_space(*iter);
+}
+
+/*
+ * status is the first failure, in order, after everything has finished.
+ * Exit within a child stops the remaining children and exits the script.
+ */
+int parallel_command::execute(Environment &env, const fdmask &fds, bool throwup) {
+
+	return begin_end_exec(begin, end, env, fds, throwup, [&](token_vector &b, process &p){
+
+		env.set("command", "end");
+
+		unsigned jobs = parallel_runner::default_jobs(env);
+		if (b.size() == 3 && b[1].string == "-j") {
+			value v(b[2]);
+			if (!v.is_number() || v.to_number() <= 0) {
+				echo_flush();
+				fprintf(stderr, "### Parallel - Invalid job count.\n");
+				fprintf(stderr, "Usage - Parallel [-j jobs]\n");
+				return -3;
+			}
+			jobs = v.to_number();
+		}
+		else if (b.size() != 1) {
+			echo_flush();
+			fprintf(stderr, "### Parallel - Too many parameters were specified.\n");
+			fprintf(stderr, "Usage - Parallel [-j jobs]\n");
+			return -3;
+		}
+
+		fdmask newfds = p.fds | fds;
+
+		int rv = 0;
+		bool exit = false;
+		int exit_value = 0;
+
+		parallel_runner runner(env, newfds, jobs, [&](const parallel_runner::result &r){
+			if (r.flow == EXIT) {
+				exit = true;
+				exit_value = r.status;
+				return false;
+			}
+			if (r.status && !rv) rv = r.status;
+			return true;
+		});
+
+		env.indent_and([&]{
+			for (auto &c : children) {
+				if (!c) continue;
+				command *cmd = c.get();
+				if (!runner.run([&env, cmd](const fdmask &fds){ return cmd->execute(env, fds); })) break;
+			}
+			runner.finish();
+		});
+
+		env.echo("end");
+
+		if (env.control_c()) throw execution_of_input_terminated();
+		if (exit) throw exit_command_t{exit_value};
+		return rv;
+	});
+}
+
+
 int loop_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 
 	return begin_end_exec(begin, end, env, fds, throwup, [&](token_vector &b, process &p){
 
 		env.set("command", "end");
 		if (b.size() != 1) {
+			echo_flush();
 			fprintf(stderr, "### Loop - Too many parameters were specified.\n");
 			fprintf(stderr, "Usage - Loop\n");
 			return -3;
@@ -710,10 +929,11 @@ int loop_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 		fdmask newfds = p.fds | fds;
 
 		int rv = 0;
+		fd_cache::scope cache;
 
 		for(;;) {
 
-			if (control_c) throw execution_of_input_terminated();
+			if (env.control_c()) throw execution_of_input_terminated();
 
 			try {
 				env.loop_indent_and([&]{
@@ -732,24 +952,100 @@ int loop_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 	});
 }
 
+/*
+ * For -p [jobs] name in [word...]
+ * iterations run concurrently, each in a forked copy of the shell.  output
+ * is replayed in iteration order.  Break, Exit or a failure with {Exit} set
+ * discards every later iteration, whether or not it already ran.
+ */
+static int parallel_for(Environment &env, const fdmask &fds, token_vector &b, unsigned jobs, command_ptr_vector &children) {
+
+	int rv = 0;
+	bool exit = false;
+	int exit_value = 0;
+
+	parallel_runner runner(env, fds, jobs, [&](const parallel_runner::result &r){
+		switch(r.flow) {
+			case BREAK:
+				return false;
+			case EXIT:
+				exit = true;
+				exit_value = r.status;
+				return false;
+		}
+		rv = r.status;
+		return !(rv && env.exit());
+	});
+
+	const std::string &name = b[1].string;
+	for (unsigned i = 3; i < b.size(); ++i) {
+
+		if (env.control_c()) break;
+
+		const std::string &word = b[i].string;
+		bool ok = runner.run([&](const fdmask &fds){
+			int rv = 0;
+			env.set(name, word);
+			env.loop_indent_and([&]{
+				for (auto &c : children) {
+					if (!c) continue;
+					rv = c->execute(env, fds);
+				}
+			});
+			env.echo("end");
+			return env.status(rv);
+		});
+		if (!ok) break;
+	}
+	runner.finish();
+
+	if (env.control_c()) throw execution_of_input_terminated();
+	if (exit) throw exit_command_t{exit_value};
+	return rv;
+}
+
 int for_command::execute(Environment &env, const fdmask &fds, bool throwup) {
 
 	return begin_end_exec(begin, end, env, fds, throwup, [&](token_vector &b, process &p){
 
 		env.set("command", "end");
 
+		// For -p [jobs] name in ...
+		bool parallel = false;
+		unsigned jobs = 0;
+		if (b.size() > 1 && b[1].string == "-p") {
+			parallel = true;
+			jobs = parallel_runner::default_jobs(env);
+			b.erase(b.begin() + 1);
+			if (b.size() > 3 && strcasecmp(b[2].string.c_str(), "in")) {
+				value v(b[1]);
+				if (!v.is_number() || v.to_number() <= 0) {
+					echo_flush();
+					fprintf(stderr, "### For - Invalid job count.\n");
+					fprintf(stderr, "Usage - For [-p [jobs]] name in [word...]\n");
+					return -3;
+				}
+				jobs = v.to_number();
+				b.erase(b.begin() + 1);
+			}
+		}
+
 		if (b.size() < 3 || strcasecmp(b[2].string.c_str(), "in")) {
+			echo_flush();
 			fprintf(stderr, "### For - Missing in keyword.\n");
-			fprintf(stderr, "Usage - For name in [word...]\n");
+			fprintf(stderr, "Usage - For [-p [jobs]] name in [word...]\n");
 			return -3;
 		}
 
 		fdmask newfds = p.fds | fds;
 
+		if (parallel) return parallel_for(env, newfds, b, jobs, children);
+
 		int rv = 0;
+		fd_cache::scope cache;
 		for (int i = 3; i < b.size(); ++i ) {
 
-			if (control_c) throw execution_of_input_terminated();
+			if (env.control_c()) throw execution_of_input_terminated();
 
 			env.set(b[1].string, b[i].string);
 
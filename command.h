@@ -7,6 +7,7 @@
 #include <array>
 #include <string>
 #include "phase3.h"
+#include "ast_arena.h"
 
 typedef std::unique_ptr<struct command> command_ptr;
 typedef std::vector<command_ptr> command_ptr_vector;
@@ -28,6 +29,10 @@ struct command {
 	int type = 0;
 	virtual ~command();
 	virtual int execute(Environment &e, const fdmask &fds, bool throwup = true) = 0;
+
+	// nodes live in the parser's arena.
+	static void *operator new(size_t size) { return ast_arena::allocate(size); }
+	static void operator delete(void *p) noexcept { ast_arena::deallocate(p); }
 };
 
 struct error_command : public command {
@@ -143,11 +148,29 @@ struct vector_command : public command {
 struct begin_command : public vector_command {
 	template<class S1, class S2>
 	begin_command(int t, command_ptr_vector &&v, S1 &&b, S2 &&e) :
-		vector_command(t, std::move(v)), begin(std::forward<S1>(b)), end(std::forward<S2>(e))
+		vector_command(t, std::move(v)), begin(std::forward<S1>(b)), end(ast_arena::intern(std::forward<S2>(e)))
 	{}
 
 	std::string begin;
-	std::string end; 
+	const std::string &end;
+
+	virtual int execute(Environment &e, const fdmask &fds, bool throwup) final override;
+};
+
+/*
+ * Parallel [-j n] ... End -- each child command runs in a forked copy of the
+ * shell.  output is buffered and replayed in order.
+ */
+struct parallel_command : public vector_command {
+	template<class S1, class S2>
+	parallel_command(int t, command_ptr_vector &&v, S1 &&b, S2 &&e) :
+		vector_command(t, std::move(v)), begin(std::forward<S1>(b)), end(ast_arena::intern(std::forward<S2>(e)))
+	{}
+
+	std::string begin;
+	const std::string &end;
+
+	static bool is_parallel(const std::string &s);
 
 	virtual int execute(Environment &e, const fdmask &fds, bool throwup) final override;
 };
@@ -156,11 +179,11 @@ struct loop_command : public vector_command {
 
 	template<class S1, class S2>
 	loop_command(int t, command_ptr_vector &&v, S1 &&b, S2 &&e) :
-		vector_command(t, std::move(v)), begin(std::forward<S1>(b)), end(std::forward<S2>(e))
+		vector_command(t, std::move(v)), begin(std::forward<S1>(b)), end(ast_arena::intern(std::forward<S2>(e)))
 	{}
 
 	std::string begin;
-	std::string end;
+	const std::string &end;
 
 	virtual int execute(Environment &e, const fdmask &fds, bool throwup) final override;
 };
@@ -169,11 +192,11 @@ struct for_command : public vector_command {
 
 	template<class S1, class S2>
 	for_command(int t, command_ptr_vector &&v, S1 &&b, S2 &&e) :
-		vector_command(t, std::move(v)), begin(std::forward<S1>(b)), end(std::forward<S2>(e))
+		vector_command(t, std::move(v)), begin(std::forward<S1>(b)), end(ast_arena::intern(std::forward<S2>(e)))
 	{}
 
 	std::string begin;
-	std::string end;
+	const std::string &end;
 
 	virtual int execute(Environment &e, const fdmask &fds, bool throwup) final override;
 };
@@ -186,24 +209,27 @@ struct if_command : public command {
 
 	template<class S>
 	if_command(clause_vector_type &&v, S &&s) :
-		command(IF), clauses(std::move(v)), end(std::forward<S>(s))
+		command(IF), clauses(std::move(v)), end(ast_arena::intern(std::forward<S>(s)))
 	{}
 
 
 	clause_vector_type clauses;
-	std::string end;
+	const std::string &end;
 
 	virtual int execute(Environment &e, const fdmask &fds, bool throwup) final override;
 };
 
 struct if_else_clause : public vector_command {
 
+	// a bare Else is interned; If/Else If lines are nearly always unique.
 	template<class S>
 	if_else_clause(int t, command_ptr_vector &&v, S &&s) :
-		vector_command(t, std::move(v)), clause(std::forward<S>(s))
+		vector_command(t, std::move(v)), text(std::forward<S>(s)),
+		clause(t == ELSE ? ast_arena::intern(std::move(text)) : text)
 	{}
 
-	std::string clause;
+	std::string text;
+	const std::string &clause;
 
 	//bool evaluate(const Environment &e);
 };
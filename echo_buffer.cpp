@@ -0,0 +1,200 @@
+#include "echo_buffer.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+
+/*
+ * one consumer (the writer thread).  producers -- shells, possibly on
+ * several threads -- take producer_mutex, so only one updates head at a time.
+ * head and tail are free-running counters; the queue mutex is only used
+ * to sleep / wake up, never to access the data.
+ */
+
+namespace {
+
+	constexpr size_t buffer_size = 64 * 1024;
+	constexpr size_t buffer_mask = buffer_size - 1;
+	static_assert((buffer_size & buffer_mask) == 0, "buffer_size must be a power of 2");
+
+	void write_all(int fd, const char *data, size_t size) {
+		while (size) {
+			ssize_t rv = ::write(fd, data, size);
+			if (rv < 0) {
+				if (errno == EINTR) continue;
+				return;
+			}
+			data += rv;
+			size -= rv;
+		}
+	}
+
+	struct echo_queue {
+
+		std::array<char, buffer_size> data;
+		std::atomic<size_t> head{0};
+		std::atomic<size_t> tail{0};
+		std::atomic<bool> sleeping{false};
+		std::atomic<bool> done{false};
+
+		std::mutex mutex;
+		std::condition_variable writer_cv;
+		std::condition_variable flush_cv;
+
+		std::thread thread;
+		pid_t pid = 0;
+		int fd = STDERR_FILENO;
+
+		size_t available() const {
+			return buffer_size - (head - tail);
+		}
+
+		void run();
+		void wake();
+		void wait(size_t needed);
+	};
+
+	echo_queue *queue = nullptr;
+	std::mutex producer_mutex;
+	std::atomic<pid_t> owner{0};
+
+	// a forked child has the queue but not the thread (and maybe not the lock).
+	bool forked() {
+		pid_t pid = owner;
+		return pid && pid != getpid();
+	}
+
+
+	void echo_queue::run() {
+		for(;;) {
+			size_t t = tail;
+			size_t h = head;
+
+			if (t == h) {
+				std::unique_lock<std::mutex> lock(mutex);
+				flush_cv.notify_all();
+				if (done) break;
+				sleeping = true;
+				writer_cv.wait(lock, [this]{ return head != tail || done; });
+				sleeping = false;
+				continue;
+			}
+
+			size_t n = std::min(h - t, buffer_size - (t & buffer_mask));
+			write_all(fd, data.data() + (t & buffer_mask), n);
+			tail = t + n;
+		}
+	}
+
+	void echo_queue::wake() {
+		if (sleeping) {
+			std::lock_guard<std::mutex> lock(mutex);
+			writer_cv.notify_one();
+		}
+	}
+
+	// wait until at least needed bytes are free.
+	void echo_queue::wait(size_t needed) {
+		if (available() >= needed) return;
+
+		std::unique_lock<std::mutex> lock(mutex);
+		writer_cv.notify_one();
+		flush_cv.wait(lock, [this, needed]{ return available() >= needed; });
+	}
+
+
+	void stop() {
+		if (!queue || queue->pid != getpid()) return;
+
+		{
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			queue->done = true;
+			queue->writer_cv.notify_one();
+		}
+		queue->thread.join();
+	}
+
+	bool start() {
+		if (queue) return queue->pid == getpid();
+
+		queue = new echo_queue;
+		queue->pid = getpid();
+		owner = queue->pid;
+
+		// the writer inherits this mask.  ^C and SIGCHLD belong to the
+		// shell thread (and child_monitor's signalfd), never the writer.
+		sigset_t mask, old_mask;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGINT);
+		sigaddset(&mask, SIGQUIT);
+		sigaddset(&mask, SIGCHLD);
+		pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+		bool ok = true;
+		try {
+			queue->thread = std::thread([]{ queue->run(); });
+		} catch (std::exception &) {
+			ok = false;
+		}
+		pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+		if (!ok) {
+			// no threads -- write synchronously.
+			queue->pid = 0;
+			return false;
+		}
+		atexit(stop);
+		return true;
+	}
+}
+
+
+void echo_write(const char *data, size_t size) {
+
+	// after a fork, the writer thread no longer exists.
+	if (forked()) {
+		write_all(STDERR_FILENO, data, size);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(producer_mutex);
+	if (!start()) {
+		write_all(STDERR_FILENO, data, size);
+		return;
+	}
+
+	if (size > buffer_size) {
+		queue->wait(buffer_size);
+		write_all(queue->fd, data, size);
+		return;
+	}
+
+	queue->wait(size);
+
+	size_t h = queue->head;
+	size_t offset = h & buffer_mask;
+	size_t n = std::min(size, buffer_size - offset);
+	std::memcpy(queue->data.data() + offset, data, n);
+	std::memcpy(queue->data.data(), data + n, size - n);
+	queue->head = h + size;
+
+	queue->wake();
+}
+
+void echo_flush() {
+	if (forked()) return;
+	std::lock_guard<std::mutex> lock(producer_mutex);
+	if (!queue || queue->pid != getpid()) return;
+	if (queue->head == queue->tail) return;
+	queue->wait(buffer_size);
+}
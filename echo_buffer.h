@@ -0,0 +1,16 @@
+#ifndef __echo_buffer_h__
+#define __echo_buffer_h__
+
+#include <cstddef>
+
+/*
+ * {Echo} output is queued in a ring buffer and written to stderr
+ * by a background thread.  Anything else that writes to stdout or
+ * stderr (diagnostics, builtins, child processes) must call
+ * echo_flush() first so the output stays in order.
+ */
+
+void echo_write(const char *data, size_t size);
+void echo_flush();
+
+#endif
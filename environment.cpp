@@ -1,10 +1,13 @@
 #include "environment.h"
 #include <cstdio>
 #include <cstdarg>
+#include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
 
 #include "error.h"
+#include "echo_buffer.h"
 
 namespace {
 
@@ -40,6 +43,36 @@ namespace {
 
 	int to_pound_int(long n) { return std::max(n, (long)0); }
 
+	const char *read_only_variables[] = {
+		"commandusertime",
+		"commandsystemtime",
+		"commandmaxrss",
+		"commandpagefaults",
+		"commandcontextswitches",
+		"scriptusertime",
+		"scriptsystemtime",
+		"scriptmaxrss",
+		"scriptpagefaults",
+		"scriptcontextswitches",
+		"scriptcommands",
+	};
+
+	// #, parameters, "parameters" or a number (as std::to_string would write it).
+	bool is_positional(const std::string &k) {
+		if (k.empty()) return false;
+		if (k == "#" || k == "parameters" || k == "\"parameters\"") return true;
+		if (k.size() > 9 || (k.size() > 1 && k[0] == '0')) return false;
+		return std::all_of(k.begin(), k.end(), [](char c){ return c >= '0' && c <= '9'; });
+	}
+
+	void check_read_only(const std::string &k) {
+		for (const char *cp : read_only_variables) {
+			if (k == cp) {
+				throw mpw_error(1, "MPW Shell - {" + k + "} is a read-only variable.");
+			}
+		}
+	}
+
 }
 
 
@@ -47,16 +80,20 @@ namespace {
 		/* clone the current environment, do not include local variables */
 		Environment env;
 		env._alias_table = _alias_table;
+		env._control_c = _control_c;
 		
 		auto &table = env._table;
 		for (const auto &kv : _table) {
 			const auto &k = kv.first;
 			const auto &value = kv.second;
 			if (!value) continue;
+			// the subshell gets its own parameters.
+			if (_has_argv && is_positional(k)) continue;
 
 			if (k == "echo") env._echo = tf(value);
 			if (k == "exit") env._exit = tf(value);
 			if (k == "test") env._test = tf(value);
+			if (k == "transcodeoutput") env._transcode = tf(value);
 
 			table.emplace_hint(table.end(), k, value);
 		}
@@ -74,12 +111,14 @@ namespace {
 	Environment::iterator Environment::find( const std::string & key ) {
 		std::string k(key);
 		lowercase(k);
+		if (_has_argv && is_positional(k)) materialize(k);
 		return _table.find(k);
 	}
 
 	Environment::const_iterator Environment::find( const std::string & key ) const {
 		std::string k(key);
 		lowercase(k);
+		if (_has_argv && is_positional(k)) materialize(k);
 		return _table.find(k);
 	}
 
@@ -87,12 +126,16 @@ namespace {
 	void Environment::set(const std::string &key, const std::string &value, bool exported) {
 		std::string k(key);
 		lowercase(k);
+		check_read_only(k);
 
 		if (k == "echo") _echo = tf(value);
 		if (k == "exit") _exit = tf(value);
 		if (k == "test") _test = tf(value);
+		if (k == "transcodeoutput") _transcode = tf(value);
 		if (k == "#") _pound = to_pound_int(value);
 
+		if (_has_argv && set_positional(k, value, exported)) return;
+
 		// don't need to check {status} because that will be clobbered
 		// by the return value.
 		set_common(k, value, exported);
@@ -101,17 +144,52 @@ namespace {
 	void Environment::set(const std::string &key, long value, bool exported) {
 		std::string k(key);
 		lowercase(k);
+		check_read_only(k);
 
 		if (k == "echo") _echo = tf(value);
 		if (k == "exit") _exit = tf(value);
 		if (k == "test") _test = tf(value);
+		if (k == "transcodeoutput") _transcode = tf(value);
 		if (k == "#") _pound = to_pound_int(value);
 
+		if (_has_argv && set_positional(k, std::to_string(value), exported)) return;
+
 		// don't need to check {status} because that will be clobbered
 		// by the return value.
 		set_common(k, std::to_string(value), exported);
 	}
 
+	bool Environment::append(const std::string &key, const std::string &suffix) {
+
+		auto has_quote = [](const char *cp, size_t size) {
+			return memchr(cp, '"', size) || memchr(cp, 0xb6, size);
+		};
+
+		std::string k(key);
+		lowercase(k);
+
+		if (k == "echo" || k == "exit" || k == "test" || k == "transcodeoutput" || k == "status" || k == "#") return false;
+		if (_has_argv && is_positional(k)) return false;
+		for (const char *cp : read_only_variables) {
+			if (k == cp) return false;
+		}
+		if (has_quote(suffix.data(), suffix.size())) return false;
+
+		auto iter = _table.find(k);
+		if (iter == _table.end()) {
+			iter = _table.emplace(std::move(k), EnvironmentEntry(suffix)).first;
+			iter->second.plain = suffix.size();
+			return true;
+		}
+
+		// only the part that hasn't been checked before.
+		auto &e = iter->second;
+		if (has_quote(e.value.data() + e.plain, e.value.size() - e.plain)) return false;
+		e.value.append(suffix);
+		e.plain = e.value.size();
+		return true;
+	}
+
 #if 0
 	void Environment::set_argv(const std::string &argv0, const std::vector<std::string>& argv) {
 		set_common("0", argv0, false);
@@ -119,48 +197,109 @@ namespace {
 	}
 #endif
 	void Environment::set_argv(const std::vector<std::string>& argv) {
-		_pound = argv.size() - 1;
-		set_common("#", std::to_string(_pound), false);
+		forget_argv();
+		_has_argv = true;
+		_argv = argv;
+		if (_argv.empty()) _argv.emplace_back();
+		_shift = 0;
+		_pound = _argv.size() - 1;
+
+		// plain variables that were set before these became parameters.
+		_table.erase("#");
+		_table.erase("parameters");
+		_table.erase("\"parameters\"");
+		for (int i = 0; i <= _pound; ++i) _table.erase(std::to_string(i));
+	}
 
-		int n = 0;
-		for (const auto &s : argv) {
-			set_common(std::to_string(n++), s, false);
-		}
+	void Environment::shift(int n) {
+		if (n < 0) return;
+		if (_pound < 1) return;
+		if (!_has_argv) return;
+
+		n = std::min(n, _pound);
+		_shift += n;
+		_pound -= n;
+		forget_argv();
 
-		// parameters, "parameters" ...
-		std::string p;
-		for (const auto &s : argv) {
-			p.push_back('"');
-			p += s;
-			p.push_back('"');
-			p.push_back(' ');
+		// don't let a long-running Loop ... Shift hold every old parameter.
+		if (_shift > 64 && _shift * 2 > _argv.size()) {
+			_argv.erase(_argv.begin() + 1, _argv.begin() + 1 + _shift);
+			_shift = 0;
 		}
-		p.pop_back();
-		set_common("\"parameters\"", p, false);
-		p.clear();
+	}
 
-		for (const auto &s : argv) {
-			p += s;
-			p.push_back(' ');
+	// drop the copies in _table; they'll be recreated on demand.
+	void Environment::forget_argv() {
+		for (const auto &k : _argv_keys) _table.erase(k);
+		_argv_keys.clear();
+		_argv_synced = false;
+	}
+
+	void Environment::materialize(const std::string &k) const {
+
+		if (_table.find(k) != _table.end()) return;
+
+		std::string value;
+		if (k == "#") {
+			value = std::to_string(_pound);
+		}
+		else if (k == "parameters" || k == "\"parameters\"") {
+			// {0} included, as always.
+			bool quoted = k[0] == '"';
+			for (int i = 0; i <= _pound; ++i) {
+				size_t index = i ? _shift + i : 0;
+				if (index >= _argv.size()) break;
+				if (i) value.push_back(' ');
+				if (quoted) value.push_back('"');
+				value += _argv[index];
+				if (quoted) value.push_back('"');
+			}
+		}
+		else {
+			size_t n = std::stoul(k);
+			if (n > (size_t)_pound) return;
+			size_t index = n ? _shift + n : 0;
+			if (index >= _argv.size()) return;
+			value = _argv[index];
 		}
-		p.pop_back();
-		set_common("parameters", p, false);
+		_table.emplace(k, EnvironmentEntry(std::move(value)));
+		_argv_keys.push_back(k);
 	}
 
-	void Environment::shift(int n) {
-		if (n < 0) return;
-		if (_pound < 1) return;
+	void Environment::sync_argv() const {
+		if (!_has_argv || _argv_synced) return;
 
-		std::vector<std::string> argv;
-		argv.push_back(get("0"));
+		materialize("#");
+		materialize("parameters");
+		materialize("\"parameters\"");
+		for (int i = 0; i <= _pound; ++i) materialize(std::to_string(i));
+		_argv_synced = true;
+	}
 
-		for (int i = 1 + n; i <= _pound; ++i) {
-			argv.push_back(get(std::to_string(i)));
+	// returns false if k isn't a parameter (or is past {#}).
+	bool Environment::set_positional(const std::string &k, const std::string &value, bool exported) {
+
+		if (!is_positional(k)) return false;
+
+		if (k == "#") {
+			// _pound is already set.
+			if (_argv.size() < _shift + _pound + 1) _argv.resize(_shift + _pound + 1);
+			forget_argv();
+			return true;
 		}
-		for (int i = 0; i < n; ++i) {
-			unset(std::to_string(_pound - i));
+
+		if (k[0] >= '0' && k[0] <= '9') {
+			size_t n = std::stoul(k);
+			if (n > (size_t)_pound) return false;
+			_argv[n ? _shift + n : 0] = value;
+			_table.erase(k);
 		}
-		set_argv(argv);
+
+		// {Parameters} isn't rebuilt until the next Shift.
+		set_common(k, value, exported);
+		if (std::find(_argv_keys.begin(), _argv_keys.end(), k) == _argv_keys.end())
+			_argv_keys.push_back(k);
+		return true;
 	}
 
 
@@ -186,22 +325,57 @@ namespace {
 	void Environment::unset(const std::string &key) {
 		std::string k(key);
 		lowercase(k);
+		check_read_only(k);
 		if (k == "echo") _echo = false;
 		if (k == "exit") _exit = false;
 		if (k == "test") _test = false;
+		if (k == "transcodeoutput") _transcode = false;
 		if (k == "#") _pound = 0;
+		if (_has_argv && is_positional(k)) {
+			if (k == "#") forget_argv();
+			else if (k[0] >= '0' && k[0] <= '9') {
+				size_t n = std::stoul(k);
+				if (n <= (size_t)_pound) _argv[n ? _shift + n : 0].clear();
+			}
+		}
 		_table.erase(k);
 	}
 
 	void Environment::unset() {
 		_table.clear();
+		_has_argv = false;
+		_argv.clear();
+		_argv_keys.clear();
+		_shift = 0;
 		_echo = false;
 		_exit = false;
 		_test = false;
+		_transcode = false;
 		_status = 0;	
 	}
 
 
+	void Environment::add_usage(const resource_usage &ru) {
+
+		_command_usage = ru;
+		_script_usage += ru;
+
+		// times are in milliseconds.
+		set_common("commandusertime", std::to_string(ru.user_time / 1000), false);
+		set_common("commandsystemtime", std::to_string(ru.system_time / 1000), false);
+		set_common("commandmaxrss", std::to_string(ru.max_rss), false);
+		set_common("commandpagefaults", std::to_string(ru.minor_faults + ru.major_faults), false);
+		set_common("commandcontextswitches", std::to_string(ru.voluntary_switches + ru.involuntary_switches), false);
+
+		const auto &s = _script_usage;
+		set_common("scriptusertime", std::to_string(s.user_time / 1000), false);
+		set_common("scriptsystemtime", std::to_string(s.system_time / 1000), false);
+		set_common("scriptmaxrss", std::to_string(s.max_rss), false);
+		set_common("scriptpagefaults", std::to_string(s.minor_faults + s.major_faults), false);
+		set_common("scriptcontextswitches", std::to_string(s.voluntary_switches + s.involuntary_switches), false);
+		set_common("scriptcommands", std::to_string(s.commands), false);
+	}
+
 	int Environment::status(int i, const std::nothrow_t &) {
 
 		if (_status == i) return i;
@@ -222,15 +396,18 @@ namespace {
 
 	void Environment::echo(const char *fmt, ...) const {
 		if (_echo && !_startup) {
-			for (int i = 0; i <= _indent; ++i) {
-				fputc(' ', stderr);
-				fputc(' ', stderr);
-			}
+			std::string s(2 * (_indent + 1), ' ');
+
+			char *cp = nullptr;
 			va_list ap;
 			va_start(ap, fmt);
-			vfprintf(stderr, fmt, ap);
+			int len = vasprintf(&cp, fmt, ap);
 			va_end(ap);
-			fputc('\n', stderr);
+			if (len > 0) s.append(cp, len);
+			free(cp);
+
+			s.push_back('\n');
+			echo_write(s.data(), s.size());
 		}
 	}
 
@@ -1,6 +1,7 @@
 #ifndef __environment_h__
 #define __environment_h__
 
+#include <atomic>
 #include <map>
 #include <new>
 #include <string>
@@ -8,7 +9,10 @@
 #include <utility>
 #include <vector>
 
+#include "resource_usage.h"
 
+// set by mpw-shell's SIGINT handler.
+extern std::atomic<int> control_c;
 
 // environment has a bool which indicates if exported.
 struct EnvironmentEntry {
@@ -17,7 +21,7 @@ public:
 	operator bool&() { return exported; }
 
 	operator const std::string&() const { return value; }
-	operator std::string&() { return value; }
+	operator std::string&() { plain = 0; return value; }
 
 	const char *c_str() const { return value.c_str(); }
 
@@ -33,13 +37,17 @@ public:
 	~EnvironmentEntry() = default;
 
 	EnvironmentEntry& operator=(bool rhs) { exported = rhs; return *this; }
-	EnvironmentEntry& operator=(const std::string &rhs) { value = rhs; return *this; }
+	EnvironmentEntry& operator=(const std::string &rhs) { value = rhs; plain = 0; return *this; }
 	EnvironmentEntry& operator=(const EnvironmentEntry &) = default;
 	EnvironmentEntry& operator=(EnvironmentEntry &&) = default;
 
 private:
+	friend class Environment;
+
 	std::string value;
 	bool exported = false;
+	// leading bytes known to have no " or ∂ (see Environment::append).
+	size_t plain = 0;
 
 };
 
@@ -62,10 +70,16 @@ public:
 	// void set_argv(const std::string &argv0, const std::vector<std::string>& argv);
 	void set_argv(const std::vector<std::string>& argv);
 
+	// constant time -- see _argv.
 	void shift(int n);
 
 	void set(const std::string &k, const std::string &value, bool exported = false);
 	void set(const std::string &k, long l, bool exported = false);
+
+	// Set k "{k}suffix", in place.  returns false (and does nothing) if k
+	// is special or the value has a " or ∂ in it, since putting it back in
+	// quotes wouldn't give the same string.
+	bool append(const std::string &k, const std::string &suffix);
 	void unset(const std::string &k);
 	void unset();
 
@@ -74,6 +88,7 @@ public:
 	bool echo() const noexcept { return _echo; }
 	bool test() const noexcept { return _test; }
 	bool exit() const noexcept { return _exit; }
+	bool transcode() const noexcept { return _transcode; }
 	int status() const noexcept { return _status; }
 	int pound() const noexcept { return _pound; }
 
@@ -83,12 +98,22 @@ public:
 	bool startup() const noexcept { return _startup; }
 	void startup(bool tf) noexcept { _startup = tf; }
 
+	// non-zero after ^C.  subshells share their parent's flag.  the
+	// process-wide ::control_c unless an embedding gives each shell its own.
+	std::atomic<int> &control_c() const noexcept { return *_control_c; }
+	void control_c(std::atomic<int> &flag) noexcept { _control_c = &flag; }
+
+	// {CommandUserTime}, etc are read-only and updated after each external command.
+	const resource_usage &command_usage() const noexcept { return _command_usage; }
+	const resource_usage &script_usage() const noexcept { return _script_usage; }
+	void add_usage(const resource_usage &ru);
+
 	template<class FX>
-	void foreach(FX && fx) { for (const auto &kv : _table) { fx(kv.first, kv.second); }}
+	void foreach(FX && fx) { sync_argv(); for (const auto &kv : _table) { fx(kv.first, kv.second); }}
 
-	iterator begin() { return _table.begin(); }
-	const_iterator begin() const { return _table.begin(); }
-	const_iterator cbegin() const { return _table.cbegin(); }
+	iterator begin() { sync_argv(); return _table.begin(); }
+	const_iterator begin() const { sync_argv(); return _table.begin(); }
+	const_iterator cbegin() const { sync_argv(); return _table.cbegin(); }
 
 	iterator end() { return _table.end(); }
 	const_iterator end() const { return _table.end(); }
@@ -137,16 +162,39 @@ private:
 
 	bool _exit = false;
 	bool _test = false;
+	bool _transcode = false;
 
 	bool _echo = false;
 	int _status = 0;
 	int _pound = 0;
 	bool _startup = false;
+	std::atomic<int> *_control_c = &::control_c;
+
+	resource_usage _command_usage;
+	resource_usage _script_usage;
 
 	void set_common(const std::string &, const std::string &, bool);
 	void rebuild_aliases();
 
-	mapped_type _table;
+	/*
+	 * positional parameters.  {n} is _argv[_shift + n] ({0} is _argv[0])
+	 * so Shift only moves _shift.  {0}, {1}..., {#}, {Parameters} and
+	 * {"Parameters"} are copied into _table when looked up (or when the
+	 * table is walked); _argv_keys lists those copies so Shift and
+	 * set_argv can drop them.
+	 */
+	bool _has_argv = false;
+	std::vector<std::string> _argv;
+	size_t _shift = 0;
+	mutable std::vector<std::string> _argv_keys;
+	mutable bool _argv_synced = false;
+
+	bool set_positional(const std::string &k, const std::string &value, bool exported);
+	void materialize(const std::string &k) const;
+	void sync_argv() const;
+	void forget_argv();
+
+	mutable mapped_type _table;
 
 	alias_table_type _alias_table;
 };
@@ -0,0 +1,65 @@
+#include "fd_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+	thread_local fd_cache *current = nullptr;
+
+	// fifos and sockets behave differently if they're held open.
+	bool cacheable(const struct stat &st) {
+		return S_ISREG(st.st_mode) || S_ISCHR(st.st_mode);
+	}
+
+}
+
+
+fd_cache::~fd_cache() {
+	for (auto &e : _entries) close(e.fd);
+}
+
+
+fd_cache::scope::scope() {
+	if (!current) current = _cache = new fd_cache;
+}
+
+fd_cache::scope::~scope() {
+	if (_cache) {
+		current = nullptr;
+		delete _cache;
+	}
+}
+
+
+int fd_cache::lookup(const std::string &path) {
+
+	struct stat st;
+	bool exists = stat(path.c_str(), &st) == 0;
+
+	for (auto &e : _entries) {
+		if (e.stale || e.path != path) continue;
+		if (exists && e.dev == st.st_dev && e.ino == st.st_ino) return e.fd;
+		// deleted or replaced -- keep it open (it may be in use) but don't hand it out.
+		e.stale = true;
+		break;
+	}
+
+	if (exists && !cacheable(st)) return -1;
+	if (_entries.size() >= max_entries) return -1;
+
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+	if (fd < 0) return -1;
+	if (fstat(fd, &st) < 0 || !cacheable(st)) {
+		close(fd);
+		return -1;
+	}
+	_entries.push_back({path, fd, st.st_dev, st.st_ino, false});
+	return fd;
+}
+
+
+int fd_cache::append(const std::string &path) {
+	return current ? current->lookup(path) : -1;
+}
@@ -0,0 +1,62 @@
+#ifndef __fd_cache_h__
+#define __fd_cache_h__
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+/*
+ * open >> ≥≥ ∑∑ files once per loop rather than once per command.
+ *
+ * Loop and For set a cache while they run; append redirections inside
+ * borrow its descriptor (the fdset doesn't close it).  the descriptors
+ * are O_APPEND, so writes from other commands, tools or a > that truncates
+ * the file still land in order.  each use stats the path -- if the file
+ * was deleted or replaced, it's reopened.  nothing is closed until the
+ * outermost loop finishes (an enclosing Begin ... End >> file may still be
+ * using it), so once the cache is full, files are opened as usual.
+ */
+class fd_cache {
+
+public:
+
+	fd_cache() = default;
+	~fd_cache();
+
+	fd_cache(const fd_cache &) = delete;
+	fd_cache &operator=(const fd_cache &) = delete;
+
+	// borrowed descriptor appending to path (a unix path), or -1 if the
+	// caller should open it.
+	static int append(const std::string &path);
+
+	// a cache for the duration; nested scopes share the outermost one.
+	class scope {
+	public:
+		scope();
+		~scope();
+		scope(const scope &) = delete;
+		scope &operator=(const scope &) = delete;
+	private:
+		fd_cache *_cache = nullptr;
+	};
+
+private:
+
+	static const size_t max_entries = 16;
+
+	struct entry {
+		std::string path;
+		int fd;
+		dev_t dev;
+		ino_t ino;
+		bool stale;
+	};
+
+	int lookup(const std::string &path);
+
+	std::vector<entry> _entries;
+};
+
+#endif
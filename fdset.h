@@ -89,7 +89,7 @@ class fdmask {
 /*
  * fd set owns it's descriptors and will close them.
  *
- *
+ * (except borrowed ones -- see fd_cache.h)
  */
 
 class fdset {
@@ -99,6 +99,7 @@ class fdset {
 	fdset(const fdset &) = delete;
 	fdset(fdset && rhs) {
 		std::swap(rhs._fds, _fds);
+		std::swap(rhs._borrowed, _borrowed);
 	}
 
 	~fdset() {
@@ -109,23 +110,33 @@ class fdset {
 	fdset &operator=(fdset &&rhs) {
 		if (&rhs != this) {
 			std::swap(_fds, rhs._fds);
+			std::swap(_borrowed, rhs._borrowed);
 			rhs.close();
 		}
 		return *this;
 	}
 
 	void close(void) {
-		for (int &fd : _fds) {
+		for (int i = 0; i < 3; ++i) {
+			int &fd = _fds[i];
 			if (fd >= 0) {
-				::close(fd);
+				if (!(_borrowed & (1 << i))) ::close(fd);
 				fd = -1;
 			}
 		}
+		_borrowed = 0;
 	}
 
 	void set(int index, int fd) {
-		std::swap(fd, _fds[index]);
-		if (fd >= 0) ::close(fd);
+		release(index);
+		_fds[index] = fd;
+	}
+
+	// fd belongs to someone else and won't be closed.
+	void borrow(int index, int fd) {
+		release(index);
+		_fds[index] = fd;
+		_borrowed |= 1 << index;
 	}
 
 	fdmask to_mask() const {
@@ -134,17 +145,29 @@ class fdset {
 
 	void swap_in_out() {
 		std::swap(_fds[0], _fds[1]);
+		unsigned b = _borrowed & ~3u;
+		if (_borrowed & 1) b |= 2;
+		if (_borrowed & 2) b |= 1;
+		_borrowed = b;
 	}
 
 	private:
 
 	void reset() {
 		_fds = {{ -1, -1, -1 }};
+		_borrowed = 0;
 	}
 
+	void release(int index) {
+		int fd = _fds[index];
+		if (fd >= 0 && !(_borrowed & (1 << index))) ::close(fd);
+		_fds[index] = -1;
+		_borrowed &= ~(1u << index);
+	}
 
 
 	std::array<int, 3> _fds = {{ -1, -1, -1 }};
+	unsigned _borrowed = 0;
 
 };
 
@@ -160,9 +183,18 @@ inline fdmask operator|(const fdset &lhs, const fdmask &rhs) {
 	return tmp;
 }
 
+// file names from > >> < ≥ ≥≥ ∑ ∑∑, in order.
+struct redirection {
+	enum { input = 1 << 0, output = 1 << 1, error = 1 << 2 };
+	unsigned fds = 0;
+	bool append = false;
+	std::string name;
+};
+
 struct process {
 	std::vector<std::string> arguments;
 	fdset fds;
+	std::vector<redirection> redirections;
 };
 
 
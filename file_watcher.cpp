@@ -0,0 +1,194 @@
+#include "file_watcher.h"
+
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <thread>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#include "cxx/string_splitter.h"
+
+namespace {
+
+	// cwd + a/./b/../c -> /cwd/a/c so a file named two ways is one file.
+	std::string absolute(const std::string &path) {
+		std::string s = path;
+		if (s.empty() || s.front() != '/') {
+			char cwd[PATH_MAX];
+			if (getcwd(cwd, sizeof(cwd))) s = std::string(cwd) + "/" + s;
+		}
+
+		std::vector<std::string> parts;
+		for (string_splitter ss(s, '/'); ss; ++ss) {
+			const std::string &p = *ss;
+			if (p.empty() || p == ".") continue;
+			if (p == "..") { if (!parts.empty()) parts.pop_back(); continue; }
+			parts.push_back(p);
+		}
+		std::string rv;
+		for (const auto &p : parts) { rv.push_back('/'); rv += p; }
+		return rv.empty() ? "/" : rv;
+	}
+
+	std::string dirname(const std::string &path) {
+		size_t pos = path.rfind('/');
+		return path.substr(0, pos + 1);
+	}
+
+	const unsigned poll_interval = 250; // ms
+
+}
+
+
+file_watcher::file_watcher() {
+#if defined(__linux__)
+	_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+file_watcher::~file_watcher() {
+	if (_fd >= 0) close(_fd);
+}
+
+
+void file_watcher::watch(const std::vector<std::string> &paths) {
+
+	_files.clear();
+	std::set<std::string> dirs;
+	for (const auto &p : paths) {
+		std::string abs = absolute(p);
+		_files.emplace(abs, p);
+		dirs.insert(dirname(abs));
+	}
+
+	if (_fd < 0) {
+		// keep the old dates so pending() sees what changed in between.
+		std::unordered_map<std::string, stat_cache::entry> snapshot;
+		for (const auto &kv : _files) {
+			auto iter = _snapshot.find(kv.first);
+			snapshot.emplace(kv.first, iter != _snapshot.end() ? iter->second : stat_cache::stat(kv.first));
+		}
+		_snapshot = std::move(snapshot);
+		return;
+	}
+
+#if defined(__linux__)
+	// directories nothing is in any more stop being watched.
+	for (auto iter = _dirs.begin(); iter != _dirs.end(); ) {
+		if (dirs.count(iter->second)) { ++iter; continue; }
+		inotify_rm_watch(_fd, iter->first);
+		iter = _dirs.erase(iter);
+	}
+
+	const uint32_t mask = IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+	for (const auto &d : dirs) {
+		// the same directory returns the same descriptor.  missing directories
+		// (an object directory that hasn't been made yet) are picked up next time.
+		int wd = inotify_add_watch(_fd, d.c_str(), mask);
+		if (wd >= 0) _dirs[wd] = d;
+	}
+#endif
+}
+
+
+bool file_watcher::read_events(int timeout_ms, std::vector<std::string> &changed) {
+
+	bool rv = false;
+#if defined(__linux__)
+	struct pollfd pfd = { _fd, POLLIN, 0 };
+	int ok = poll(&pfd, 1, timeout_ms);
+	if (ok <= 0) return false;
+
+	alignas(struct inotify_event) char buffer[16384];
+	for(;;) {
+		ssize_t size = read(_fd, buffer, sizeof(buffer));
+		if (size < 0 && errno == EINTR) continue;
+		if (size <= 0) break;
+
+		for (char *cp = buffer; cp < buffer + size; ) {
+			const struct inotify_event *ev = (const struct inotify_event *)cp;
+			cp += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				// lost events -- assume everything changed.
+				for (const auto &kv : _files) changed.push_back(kv.second);
+				rv = true;
+				continue;
+			}
+			if (ev->mask & IN_IGNORED) {
+				_dirs.erase(ev->wd);
+				continue;
+			}
+			if (!ev->len) continue;
+
+			auto iter = _dirs.find(ev->wd);
+			if (iter == _dirs.end()) continue;
+			auto f = _files.find(iter->second + ev->name);
+			if (f == _files.end()) continue;
+			changed.push_back(f->second);
+			rv = true;
+		}
+	}
+#endif
+	return rv;
+}
+
+
+bool file_watcher::poll_files(std::vector<std::string> &changed) {
+
+	bool rv = false;
+	for (auto &kv : _snapshot) {
+		auto e = stat_cache::stat(kv.first);
+		if (e == kv.second) continue;
+		kv.second = e;
+		changed.push_back(_files[kv.first]);
+		rv = true;
+	}
+	return rv;
+}
+
+
+std::vector<std::string> file_watcher::pending() {
+
+	std::vector<std::string> changed;
+	if (_fd < 0) poll_files(changed);
+	else while (read_events(0, changed)) ;
+
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+	return changed;
+}
+
+
+std::vector<std::string> file_watcher::wait(unsigned delay_ms) {
+
+	std::vector<std::string> changed;
+
+	if (_fd < 0) {
+		while (!poll_files(changed))
+			std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval));
+		_first = std::chrono::steady_clock::now();
+		do {
+			std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+		} while (poll_files(changed));
+	}
+	else {
+		while (!read_events(-1, changed)) ;
+		_first = std::chrono::steady_clock::now();
+		while (read_events(delay_ms, changed)) ;
+	}
+
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+	return changed;
+}
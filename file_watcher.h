@@ -0,0 +1,55 @@
+#ifndef __file_watcher_h__
+#define __file_watcher_h__
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "stat_cache.h"
+
+/*
+ * waits for a set of files to change (mpw-make --watch).
+ *
+ * on linux, the directories holding the files are watched with inotify
+ * (so editors that save by renaming are noticed).  elsewhere, or if
+ * inotify isn't available, the files are polled.
+ */
+class file_watcher {
+
+public:
+
+	file_watcher();
+	~file_watcher();
+
+	file_watcher(const file_watcher &) = delete;
+	file_watcher &operator=(const file_watcher &) = delete;
+
+	// replaces the watched set.  relative paths are relative to the current directory.
+	void watch(const std::vector<std::string> &paths);
+
+	// blocks until a watched file changes, then collects changes until
+	// there's been delay_ms of quiet.  returns the paths as passed to watch().
+	std::vector<std::string> wait(unsigned delay_ms);
+
+	// changes since the last call, without waiting (eg, files the build wrote).
+	std::vector<std::string> pending();
+
+	// when the first change of the last wait() was seen.
+	std::chrono::steady_clock::time_point first_event() const noexcept { return _first; }
+
+	bool polling() const noexcept { return _fd < 0; }
+
+private:
+
+	bool read_events(int timeout_ms, std::vector<std::string> &changed);
+	bool poll_files(std::vector<std::string> &changed);
+
+	int _fd = -1;
+	std::unordered_map<int, std::string> _dirs; // watch descriptor -> directory/
+	std::unordered_map<std::string, std::string> _files; // absolute path -> path as given
+	std::unordered_map<std::string, stat_cache::entry> _snapshot; // polling only
+	std::chrono::steady_clock::time_point _first;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __hash128_h__
+#define __hash128_h__
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * 128-bit content hash -- two independent 64-bit hashes (fnv-1a and a
+ * multiply/xorshift) over the same bytes.  not cryptographic.
+ */
+class hash128 {
+public:
+	void update(const void *data, size_t size) {
+		const unsigned char *cp = (const unsigned char *)data;
+		uint64_t a = _a;
+		uint64_t b = _b;
+		for (size_t i = 0; i < size; ++i) {
+			a = (a ^ cp[i]) * UINT64_C(0x100000001b3);
+			b = (b ^ cp[i]) * UINT64_C(0xff51afd7ed558ccd);
+			b ^= b >> 29;
+		}
+		_a = a;
+		_b = b;
+	}
+
+	void update(uint64_t x) {
+		update(&x, sizeof(x));
+	}
+
+	void update(const std::string &s) {
+		update(s.size());
+		update(s.data(), s.size());
+	}
+
+	std::string hex() const {
+		char buffer[33];
+		snprintf(buffer, sizeof(buffer), "%016" PRIx64 "%016" PRIx64, _a, _b);
+		return buffer;
+	}
+
+private:
+	uint64_t _a = UINT64_C(0xcbf29ce484222325);
+	uint64_t _b = UINT64_C(0x9e3779b97f4a7c15);
+};
+
+#endif
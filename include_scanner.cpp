@@ -0,0 +1,353 @@
+#include "include_scanner.h"
+#include "environment.h"
+#include "hash128.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <set>
+#include <thread>
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cxx/string_splitter.h"
+
+namespace ToolBox {
+	std::string MacToUnix(const std::string path);
+}
+
+namespace {
+
+	bool read_all(const std::string &path, std::string &out) {
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) return false;
+		char buffer[65536];
+		out.clear();
+		for(;;) {
+			ssize_t size = read(fd, buffer, sizeof(buffer));
+			if (size < 0 && errno == EINTR) continue;
+			if (size < 0) { close(fd); return false; }
+			if (size == 0) break;
+			out.append(buffer, size);
+		}
+		close(fd);
+		return true;
+	}
+
+	bool is_file(const std::string &path) {
+		struct stat st;
+		return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+	}
+
+	// {CIncludes} may be a comma-separated list.
+	std::vector<std::string> search_path(const Environment &env, const char *name) {
+		std::vector<std::string> rv;
+		std::string value = env.get(name);
+		for (string_splitter ss(value, ','); ss; ++ss) {
+			if (ss->empty()) continue;
+			std::string s = ToolBox::MacToUnix(*ss);
+			if (s.back() != '/') s.push_back('/');
+			rv.push_back(std::move(s));
+		}
+		return rv;
+	}
+
+	// a/./b/../c -> a/c so a header found two ways is one node.
+	std::string normalize(const std::string &path) {
+		std::vector<std::string> parts;
+		bool absolute = !path.empty() && path.front() == '/';
+		for (string_splitter ss(path, '/'); ss; ++ss) {
+			const std::string &s = *ss;
+			if (s.empty() || s == ".") continue;
+			if (s == ".." && !parts.empty() && parts.back() != "..") { parts.pop_back(); continue; }
+			if (s == ".." && absolute) continue;
+			parts.push_back(s);
+		}
+		std::string rv = absolute ? "/" : "";
+		for (const auto &s : parts) {
+			if (!rv.empty() && rv.back() != '/') rv.push_back('/');
+			rv += s;
+		}
+		return rv;
+	}
+
+	bool skip_space(const std::string &s, size_t &i) {
+		while (i < s.size() && (s[i] == ' ' || s[i] == '\t')) ++i;
+		return i < s.size();
+	}
+
+	bool match_word(const std::string &s, size_t &i, const char *word) {
+		size_t n = strlen(word);
+		if (strncasecmp(s.c_str() + i, word, n)) return false;
+		i += n;
+		return true;
+	}
+
+}
+
+
+include_scanner::include_scanner(const Environment &env) {
+	_c_dirs = search_path(env, "cincludes");
+	_asm_dirs = search_path(env, "aincludes");
+	_rez_dirs = search_path(env, "rincludes");
+}
+
+
+void include_scanner::search_first(const std::vector<std::string> &dirs) {
+	for (auto *v : { &_c_dirs, &_asm_dirs, &_rez_dirs })
+		v->insert(v->begin(), dirs.begin(), dirs.end());
+}
+
+
+include_scanner::language include_scanner::classify(const std::string &path) {
+	size_t pos = path.rfind('.');
+	if (pos == std::string::npos) return unknown;
+	const char *ext = path.c_str() + pos;
+	for (const char *e : { ".c", ".h", ".cp", ".cpp", ".cc", ".hpp" })
+		if (!strcasecmp(ext, e)) return c;
+	for (const char *e : { ".a", ".aii" })
+		if (!strcasecmp(ext, e)) return assembler;
+	if (!strcasecmp(ext, ".r")) return rez;
+	return unknown;
+}
+
+
+/*
+ * C / Rez:  #include "name" or <name>
+ * Asm:      INCLUDE 'name' (or "name") -- case-insensitive
+ */
+std::vector<include_scanner::directive> include_scanner::parse(const std::string &data, language lang) {
+
+	std::vector<directive> rv;
+
+	for (size_t begin = 0; begin < data.size(); ) {
+		size_t end = data.find_first_of("\r\n", begin);
+		if (end == std::string::npos) end = data.size();
+		std::string line = data.substr(begin, end - begin);
+		begin = end + 1;
+
+		size_t i = 0;
+		if (!skip_space(line, i)) continue;
+
+		if (lang == assembler) {
+			if (!match_word(line, i, "include")) continue;
+		}
+		else {
+			if (line[i++] != '#') continue;
+			if (!skip_space(line, i)) continue;
+			if (!match_word(line, i, "include")) continue;
+		}
+		if (!skip_space(line, i)) continue;
+
+		char close = line[i];
+		directive d;
+		if (close == '<' && lang != assembler) { close = '>'; d.angle = true; }
+		else if (close == '\'' && lang == assembler) ;
+		else if (close != '"') continue;
+
+		size_t j = line.find(close, i + 1);
+		if (j == std::string::npos || j == i + 1) continue;
+		d.name = line.substr(i + 1, j - i - 1);
+		rv.push_back(std::move(d));
+	}
+	return rv;
+}
+
+
+std::string include_scanner::resolve(const std::string &from, const directive &d, language lang, bool &system) const {
+
+	std::string name = d.name;
+	if (name.find(':') != std::string::npos) name = ToolBox::MacToUnix(name);
+
+	system = false;
+	if (name.front() == '/') return is_file(name) ? normalize(name) : "";
+
+	size_t pos = from.rfind('/');
+	std::string here = pos == std::string::npos ? "" : from.substr(0, pos + 1);
+	if (!d.angle && is_file(here + name)) return normalize(here + name);
+
+	const auto &dirs = lang == assembler ? _asm_dirs : lang == rez ? _rez_dirs : _c_dirs;
+	for (const auto &dir : dirs) {
+		if (is_file(dir + name)) {
+			system = true;
+			return normalize(dir + name);
+		}
+	}
+
+	if (d.angle && is_file(here + name)) return normalize(here + name);
+	return "";
+}
+
+
+std::vector<include_scanner::directive> include_scanner::directives(const std::string &path, language lang) {
+
+	std::string data;
+	if (!read_all(path, data)) return {};
+
+	hash128 h;
+	h.update(lang);
+	h.update(data);
+	std::string key = h.hex();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto iter = _cache.find(key);
+		if (iter != _cache.end()) {
+			++_cached;
+			return iter->second;
+		}
+	}
+
+	auto rv = parse(data, lang);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	++_parsed;
+	_dirty = true;
+	_cache.emplace(key, rv);
+	return rv;
+}
+
+
+std::vector<std::vector<std::string>> include_scanner::scan(const std::vector<std::string> &files, unsigned jobs, bool system) {
+
+	std::deque<std::string> queue;
+	std::condition_variable cv;
+	unsigned active = 0;
+
+	std::vector<std::string> sources;
+	for (const auto &f : files) sources.push_back(normalize(f));
+
+	for (const auto &f : sources) {
+		if (_graph.count(f)) continue;
+		node &n = _graph[f];
+		n.lang = classify(f);
+		queue.push_back(f);
+	}
+
+	// each worker parses one file at a time and queues anything new it includes.
+	auto worker = [&]() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		for(;;) {
+			cv.wait(lock, [&]{ return !queue.empty() || active == 0; });
+			if (queue.empty()) return;
+
+			std::string path = std::move(queue.front());
+			queue.pop_front();
+			language lang = _graph[path].lang;
+			++active;
+			lock.unlock();
+
+			std::vector<std::pair<std::string, bool>> includes;
+			if (lang != unknown) {
+				for (const auto &d : directives(path, lang)) {
+					bool sys;
+					std::string p = resolve(path, d, lang, sys);
+					if (!p.empty()) includes.emplace_back(std::move(p), sys);
+				}
+			}
+
+			lock.lock();
+			for (const auto &kv : includes) {
+				auto iter = _graph.find(kv.first);
+				if (iter != _graph.end()) continue;
+				node &n = _graph[kv.first];
+				n.lang = lang;
+				n.system = kv.second;
+				queue.push_back(kv.first);
+			}
+			auto &v = _graph[path].includes;
+			for (auto &kv : includes) v.push_back(std::move(kv.first));
+			--active;
+			cv.notify_all();
+		}
+	};
+
+	jobs = std::max(1u, jobs);
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < jobs; ++i) threads.emplace_back(worker);
+	worker();
+	for (auto &t : threads) t.join();
+
+	std::vector<std::vector<std::string>> rv;
+	rv.reserve(sources.size());
+	for (const auto &f : sources) {
+		std::vector<std::string> out;
+		std::set<std::string> seen = { f };
+
+		std::function<void(const std::string &)> visit = [&](const std::string &p) {
+			for (const auto &inc : _graph[p].includes) {
+				if (!seen.insert(inc).second) continue;
+				if (!system && _graph[inc].system) continue;
+				out.push_back(inc);
+				visit(inc);
+			}
+		};
+		visit(f);
+		rv.push_back(std::move(out));
+	}
+	return rv;
+}
+
+
+/*
+ * one line per file:  hash <tab> "name <tab> <name ...
+ */
+void include_scanner::load_cache(const std::string &path) {
+
+	std::string data;
+	if (!read_all(path, data)) return;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (string_splitter ls(data, '\n'); ls; ++ls) {
+		std::vector<std::string> fields;
+		for (string_splitter fs(*ls, '\t'); fs; ++fs) fields.push_back(*fs);
+		if (fields.empty() || fields[0].size() != 32) continue;
+
+		std::vector<directive> v;
+		for (size_t i = 1; i < fields.size(); ++i) {
+			if (fields[i].size() < 2) continue;
+			directive d;
+			d.angle = fields[i][0] == '<';
+			d.name = fields[i].substr(1);
+			v.push_back(std::move(d));
+		}
+		_cache.emplace(fields[0], std::move(v));
+	}
+}
+
+
+bool include_scanner::save_cache(const std::string &path) const {
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_dirty) return true;
+
+	std::string data;
+	for (const auto &kv : _cache) {
+		data += kv.first;
+		for (const auto &d : kv.second) {
+			data.push_back('\t');
+			data.push_back(d.angle ? '<' : '"');
+			data += d.name;
+		}
+		data.push_back('\n');
+	}
+
+	std::string temp = path + ".tmp";
+	int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) return false;
+	bool ok = write(fd, data.data(), data.size()) == (ssize_t)data.size();
+	close(fd);
+	if (!ok || rename(temp.c_str(), path.c_str()) < 0) {
+		unlink(temp.c_str());
+		return false;
+	}
+	return true;
+}
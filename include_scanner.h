@@ -0,0 +1,79 @@
+#ifndef __include_scanner_h__
+#define __include_scanner_h__
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Environment;
+
+/*
+ * finds the files a C, Asm or Rez source includes (directly or not).
+ *
+ * C (.c .cp .cpp .h) and Rez (.r) use #include and search {CIncludes} or
+ * {RIncludes}; Asm (.a .aii) uses INCLUDE and searches {AIncludes}.  quoted
+ * names are looked for next to the including file first.  a header is
+ * scanned in the language of the file that included it.
+ *
+ * files are read and parsed on several threads.  parse results are cached
+ * by content hash and can be saved between runs.
+ */
+class include_scanner {
+
+public:
+
+	enum language { unknown, c, assembler, rez };
+
+	include_scanner(const Environment &env);
+
+	include_scanner(const include_scanner &) = delete;
+	include_scanner &operator=(const include_scanner &) = delete;
+
+	// -i directories from a tool's command line, searched before the
+	// include variables in every language.
+	void search_first(const std::vector<std::string> &dirs);
+
+	void load_cache(const std::string &path);
+	bool save_cache(const std::string &path) const;
+
+	// unix paths.  returns each file's includes, in the order found.
+	// system = false skips files found through the include variables.
+	std::vector<std::vector<std::string>> scan(const std::vector<std::string> &files, unsigned jobs, bool system);
+
+	static language classify(const std::string &path);
+
+	size_t parsed() const noexcept { return _parsed; }
+	size_t cached() const noexcept { return _cached; }
+
+private:
+
+	struct directive {
+		std::string name;
+		bool angle = false;
+	};
+
+	struct node {
+		language lang = unknown;
+		bool system = false;
+		std::vector<std::string> includes;
+	};
+
+	static std::vector<directive> parse(const std::string &data, language lang);
+	std::string resolve(const std::string &from, const directive &d, language lang, bool &system) const;
+	std::vector<directive> directives(const std::string &path, language lang);
+
+	std::vector<std::string> _c_dirs;
+	std::vector<std::string> _asm_dirs;
+	std::vector<std::string> _rez_dirs;
+
+	mutable std::mutex _mutex;
+	std::unordered_map<std::string, std::vector<directive>> _cache; // content hash -> directives
+	std::map<std::string, node> _graph;
+	size_t _parsed = 0;
+	size_t _cached = 0;
+	bool _dirty = false;
+};
+
+#endif
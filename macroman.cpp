@@ -1,163 +1,251 @@
-
+#include "macroman.h"
 
 #include <string>
-#include <algorithm>
+#include <cstring>
 #include <stdint.h>
-#include <array>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
-struct mu_pair {
-	uint16_t unicode;
-	uint8_t macroman;
+namespace {
 
-	constexpr bool operator<(const mu_pair &rhs) const noexcept {
-		return unicode < rhs.unicode;
-	}
+	struct mu_pair {
+		uint8_t macroman;
+		uint16_t unicode;
+	};
 
-	constexpr bool operator==(const mu_pair &rhs) const noexcept {
-		return unicode == rhs.unicode;
-	}
+	constexpr mu_pair mapping[] = {
+#undef _
+#define _(macroman, unicode, comment)  mu_pair{ macroman, unicode } ,
+#include "macroman.x"
+#undef _
+	};
 
-	constexpr bool operator<(uint16_t c) const noexcept {
-		return unicode < c;
-	}
 
-	constexpr bool operator==(uint16_t c) const noexcept {
-		return unicode == c;
+	/*
+	 * unicode -> macroman is a two-level table.  index[cp >> 8] selects a
+	 * 256-byte page (page 0 is empty), page[cp & 0xff] is the macroman
+	 * character or 0 if there isn't one.
+	 */
+
+	constexpr unsigned count_pages() {
+		bool used[256] = {};
+		unsigned count = 1;
+		for (const auto &m : mapping) {
+			unsigned hi = m.unicode >> 8;
+			if (!used[hi]) { used[hi] = true; ++count; }
+		}
+		return count;
 	}
-};
 
-uint8_t unicode_to_macroman(uint16_t c){
+	constexpr unsigned page_count = count_pages();
 
+	struct u2m_table {
+		uint8_t index[256];
+		uint8_t pages[page_count][256];
+	};
 
-	static std::array< mu_pair, 0x80> table = {{
-#undef _
-#define _(macroman, unicode, comment)  mu_pair{ unicode, macroman } ,
-#include "macroman.x"
-#undef _
-	}};
+	constexpr u2m_table make_u2m() {
+		u2m_table t{};
+		unsigned next = 1;
+		for (const auto &m : mapping) {
+			unsigned hi = m.unicode >> 8;
+			if (!t.index[hi]) t.index[hi] = next++;
+			t.pages[t.index[hi]][m.unicode & 0xff] = m.macroman;
+		}
+		return t;
+	}
+
+	constexpr u2m_table u2m = make_u2m();
+
+
+	// macroman 0x80-0xff -> pre-encoded utf-8 (2 or 3 bytes).
+	struct utf8_char {
+		uint8_t length;
+		uint8_t bytes[3];
+	};
+
+	struct m2u_table {
+		utf8_char chars[128];
+	};
+
+	constexpr m2u_table make_m2u() {
+		m2u_table t{};
+		for (const auto &m : mapping) {
+			utf8_char &u = t.chars[m.macroman - 0x80];
+			unsigned c = m.unicode;
+			if (c <= 0x07ff) {
+				u.length = 2;
+				u.bytes[0] = 0b11000000 | (c >> 6);
+				u.bytes[1] = 0b10000000 | (c & 0b00111111);
+			} else {
+				u.length = 3;
+				u.bytes[0] = 0b11100000 | (c >> 12);
+				u.bytes[1] = 0b10000000 | ((c >> 6) & 0b00111111);
+				u.bytes[2] = 0b10000000 | (c & 0b00111111);
+			}
+		}
+		return t;
+	}
 
-	static bool init = false;
+	constexpr m2u_table m2u = make_m2u();
 
-	if (c < 0x80) return c;
 
-	if (!init) {
-		init = true;
-		std::sort(table.begin(), table.end());
-		init = true;
+	// number of leading 7-bit ascii bytes.
+	size_t ascii_span(const uint8_t *p, size_t size) {
+		size_t i = 0;
+
+#if defined(__AVX2__)
+		for (; i + 32 <= size; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+			unsigned mask = _mm256_movemask_epi8(v);
+			if (mask) return i + __builtin_ctz(mask);
+		}
+#endif
+#if defined(__SSE2__)
+		for (; i + 16 <= size; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+			unsigned mask = _mm_movemask_epi8(v);
+			if (mask) return i + __builtin_ctz(mask);
+		}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+		for (; i + 16 <= size; i += 16) {
+			uint8x16_t v = vld1q_u8(p + i);
+			if (vmaxvq_u8(v) & 0x80) break;
+		}
+#else
+		for (; i + 8 <= size; i += 8) {
+			uint64_t v;
+			memcpy(&v, p + i, 8);
+			if (v & UINT64_C(0x8080808080808080)) break;
+		}
+#endif
+		while (i < size && p[i] < 0x80) ++i;
+		return i;
 	}
 
-	auto iter = std::lower_bound(table.begin(), table.end(), c);
-	if (iter != table.end() && iter->unicode == c) return iter->macroman;
-	return 0;
 }
 
 
-uint16_t macroman_to_unicode(uint8_t c) {
+uint8_t unicode_to_macroman(uint16_t c) {
+	if (c < 0x80) return c;
+	return u2m.pages[u2m.index[c >> 8]][c & 0xff];
+}
 
-	static std::array<uint16_t, 0x80> table = {{
-#undef _
-#define _(macroman,unicode,comment) unicode ,
-#include "macroman.x"
-#undef _
-	}};
 
+uint16_t macroman_to_unicode(uint8_t c) {
 	if (c < 0x80) return c;
-	return table[c - 0x80];
-
+	const utf8_char &u = m2u.chars[c - 0x80];
+	if (u.length == 2) return ((u.bytes[0] & 0b00011111) << 6) | (u.bytes[1] & 0b00111111);
+	return ((u.bytes[0] & 0b00001111) << 12) | ((u.bytes[1] & 0b00111111) << 6) | (u.bytes[2] & 0b00111111);
 }
 
 
+/*
+ * state is the number of continuation bytes still expected (high byte)
+ * and the code point so far.  invalid sequences and characters without a
+ * macroman equivalent are dropped.
+ */
+size_t utf8_to_macroman(const void *src, size_t size, void *dst, uint32_t &state) {
 
+	const uint8_t *in = (const uint8_t *)src;
+	const uint8_t *end = in + size;
+	uint8_t *out = (uint8_t *)dst;
 
+	unsigned cs = state >> 24;
+	uint32_t tmp = state & 0x00ffffff;
 
-std::string utf8_to_macroman(const std::string &s) {
-	
-
-	if (std::find_if(s.begin(), s.end(), [](unsigned char c){ return c & 0x80; }) == s.end())
-		return s;
+	while (in != end) {
 
-	std::string rv;
-	rv.reserve(s.size());
+		if (cs == 0) {
+			size_t n = ascii_span(in, end - in);
+			if (n) {
+				memcpy(out, in, n);
+				in += n;
+				out += n;
+				if (in == end) break;
+			}
 
-	unsigned cs = 0;
-	uint16_t tmp = 0;
+			uint8_t c = *in++;
+			if ((c & 0b11100000) == 0b11000000) { tmp = c & 0b00011111; cs = 1; }
+			else if ((c & 0b11110000) == 0b11100000) { tmp = c & 0b00001111; cs = 2; }
+			else if ((c & 0b11111000) == 0b11110000) { tmp = c & 0b00000111; cs = 3; }
+			// else not utf-8.
+			continue;
+		}
 
-	for (unsigned char c : s) {
-		switch(cs) {
-		case 0:
-			if (c <= 0x7f) {
-				rv.push_back(c);
-				continue;
-			}
-			if ((c & 0b11100000) == 0b11000000) {
-				(tmp = c & 0b00011111);
-				cs = 1;
-				continue;
-			}
-			if ((c & 0b11110000) == 0b11100000) {
-				(tmp = c & 0b00001111);
-				cs = 2;
-				continue;
-			}
-			if ((c & 0b11111000) == 0b11110000) {
-				(tmp = c & 0b00000111);
-				cs = 3;
-				continue;
-			}
-			// not utf8...
-			break;
-		case 1:
-		case 2:
-		case 3:
-			if ((c & 0b11000000) != 0b10000000) {
-				//not utf8...
-			}
-			tmp = (tmp << 6) + (c & 0b00111111);
-			if (--cs == 0) {
-				c = unicode_to_macroman(tmp);
-				if (c) rv.push_back(c);
-			}
-			break;
+		uint8_t c = *in;
+		if ((c & 0b11000000) != 0b10000000) {
+			// truncated sequence -- drop it and treat c as a new character.
+			cs = 0;
+			continue;
+		}
+		++in;
+		tmp = (tmp << 6) | (c & 0b00111111);
+		if (--cs == 0 && tmp <= 0xffff) {
+			c = unicode_to_macroman(tmp);
+			if (c) *out++ = c;
 		}
 	}
 
-	return rv;
+	state = (cs << 24) | (cs ? tmp : 0);
+	return out - (uint8_t *)dst;
 }
 
 
-std::string macroman_to_utf8(const std::string &s) {
+size_t macroman_to_utf8(const void *src, size_t size, void *dst) {
 
-	if (std::find_if(s.begin(), s.end(), [](unsigned char c){ return c & 0x80; }) == s.end())
-		return s;
-
-	std::string rv;
-	rv.reserve(s.size());
-
-	for (uint8_t c : s) {
-		if (c <= 0x7f) { rv.push_back(c); continue; }
-
-		uint16_t tmp = macroman_to_unicode(c);
-
-		if (tmp <= 0x7f) {
-			rv.push_back(tmp);
-		} else if (tmp <= 0x07ff) {
-			uint8_t a,b;
-			b = tmp & 0b00111111; tmp >>= 6;
-			a = tmp;
-			rv.push_back(0b11000000 | a);
-			rv.push_back(0b10000000 | b);
-		} else { // tmp <= 0xffff
-			uint8_t a,b,c;
-			c = tmp & 0b00111111; tmp >>= 6;
-			b = tmp & 0b00111111; tmp >>= 6;
-			a = tmp;
-			rv.push_back(0b11100000 | a);
-			rv.push_back(0b10000000 | b);
-			rv.push_back(0b10000000 | c);
+	const uint8_t *in = (const uint8_t *)src;
+	const uint8_t *end = in + size;
+	uint8_t *out = (uint8_t *)dst;
+
+	while (in != end) {
+		size_t n = ascii_span(in, end - in);
+		if (n) {
+			memcpy(out, in, n);
+			in += n;
+			out += n;
+			if (in == end) break;
 		}
+
+		const utf8_char &u = m2u.chars[*in++ - 0x80];
+		out[0] = u.bytes[0];
+		out[1] = u.bytes[1];
+		out[2] = u.bytes[2];
+		out += u.length;
 	}
+
+	return out - (uint8_t *)dst;
+}
+
+
+std::string utf8_to_macroman(const std::string &s) {
+
+	size_t n = ascii_span((const uint8_t *)s.data(), s.size());
+	if (n == s.size()) return s;
+
+	std::string rv(s.size(), 0);
+	uint32_t state = 0;
+	rv.resize(utf8_to_macroman(s.data(), s.size(), &rv[0], state));
 	return rv;
 }
 
 
+std::string macroman_to_utf8(const std::string &s) {
+
+	size_t n = ascii_span((const uint8_t *)s.data(), s.size());
+	if (n == s.size()) return s;
+
+	// worst case, every character is 3 bytes.
+	std::string rv(n + (s.size() - n) * 3, 0);
+	memcpy(&rv[0], s.data(), n);
+	rv.resize(n + macroman_to_utf8(s.data() + n, s.size() - n, &rv[n]));
+	return rv;
+}
@@ -1,8 +1,23 @@
 #ifndef __macroman_h__
 #define __macroman_h__
 
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
 std::string utf8_to_macroman(const std::string &s);
 std::string macroman_to_utf8(const std::string &s);
 
+uint8_t unicode_to_macroman(uint16_t c);
+uint16_t macroman_to_unicode(uint8_t c);
+
+/*
+ * streaming versions -- no allocation.  dst must have room for size bytes
+ * (utf8_to_macroman) or 3 * size bytes (macroman_to_utf8).  state holds a
+ * partial utf-8 sequence between calls and should start as 0.
+ * returns the number of bytes written.
+ */
+size_t utf8_to_macroman(const void *src, size_t size, void *dst, uint32_t &state);
+size_t macroman_to_utf8(const void *src, size_t size, void *dst);
 
 #endif
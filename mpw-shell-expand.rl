@@ -11,6 +11,8 @@
 
 #include "mpw-shell.h"
 #include "error.h"
+#include "profile.h"
+#include "alloc_stats.h"
 
 %%{
 	
@@ -146,6 +148,7 @@ std::string subshell(const std::string &s, Environment &env, const fdmask &fds)
 	fdset new_fds;
 	new_fds.set(1, fd);
 
+	profile_span span("subshell", s);
 	int rv = 0;
 	env.indent_and([&](){
 
@@ -185,6 +188,9 @@ std::string subshell(const std::string &s, Environment &env, const fdmask &fds)
 std::string expand_vars(const std::string &s, Environment &env, const fdmask &fds) {
 	if (s.find_first_of("{`", 0, 2) == s.npos) return s;
 
+	profile_span span("expand", "expand_vars");
+	alloc_stage stage(ALLOC_EXPAND);
+
 	int cs;
 	int xcs;
 
@@ -3,6 +3,8 @@
 #include "value.h"
 #include "error.h"
 #include "mpw-regex.h"
+#include "fd_cache.h"
+#include "alloc_stats.h"
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -43,12 +45,21 @@ void open_error(const std::string &name) {
 	throw mpw_error(-4, error);	
 }
 
-int open(const std::string &name, int flags) {
+int open(const std::string &name, int flags, bool &borrowed) {
 
 	// dup2 does not copy the O_CLOEXEC flag so it's safe to use.
 
 	std::string uname = ToolBox::MacToUnix(name);
 
+	borrowed = false;
+	if (flags & O_APPEND) {
+		int fd = fd_cache::append(uname);
+		if (fd >= 0) {
+			borrowed = true;
+			return fd;
+		}
+	}
+
 	int fd = ::open(uname.c_str(), flags | O_CLOEXEC, 0666);
 	if (fd < 0) {
 		open_error(name);
@@ -62,6 +73,7 @@ void parse_tokens(std::vector<token> &&tokens, process &p) {
 
 	fdset fds;
 	std::vector<std::string> argv;
+	std::vector<redirection> redirections;
 
 	std::reverse(tokens.begin(), tokens.end());
 	argv.reserve(tokens.size());
@@ -124,8 +136,18 @@ void parse_tokens(std::vector<token> &&tokens, process &p) {
 						throw mpw_error(-4, "MPW Shell - Missing file name.");
 					}
 					token name = pop(tokens);
-					int fd = open(name.string, flags);
+					bool borrowed;
+					int fd = open(name.string, flags, borrowed);
+					redirections.push_back({fd_bits, (flags & O_APPEND) != 0, name.string});
+
 
+					if (borrowed) {
+						// cached -- stdout and stderr can share it.
+						for (int i = 0; i < 3; ++i) {
+							if (fd_bits & (1 << i)) fds.borrow(i, fd);
+						}
+						break;
+					}
 
 					// todo -- if multiple fd_bits (stdin+stderr, should dup the second fd?)
 					switch(fd_bits) {
@@ -166,6 +188,7 @@ void parse_tokens(std::vector<token> &&tokens, process &p) {
 
 	p.arguments = std::move(argv);
 	p.fds = std::move(fds);
+	p.redirections = std::move(redirections);
 }
 
 
@@ -503,6 +526,7 @@ int32_t expression_parser::evaluate() {
 
 int32_t evaluate_expression(Environment &env, const std::string &name, std::vector<token> &&tokens) {
 
+	alloc_stage stage(ALLOC_EVALUATE);
 	expression_parser p(env, name, std::move(tokens));
 	return p.evaluate();
 }
@@ -0,0 +1,186 @@
+/*
+ * shell runtime shared by mpw-shell and mpw-shell-bench (everything but main).
+ */
+
+#include <atomic>
+#include <array>
+#include <string>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cerrno>
+#include <paths.h>
+#include <pwd.h>
+#include <sys/types.h>
+
+#include "mpw-shell.h"
+#include "mpw_parser.h"
+#include "fdset.h"
+#include "error.h"
+#include "echo_buffer.h"
+
+#include "cxx/mapped_file.h"
+#include "cxx/filesystem.h"
+#include "cxx/string_splitter.h"
+
+namespace fs = filesystem;
+
+std::atomic<int> control_c{0};
+
+fs::path home() {
+
+	const char *cp = getenv("HOME");
+	if (cp && *cp) return fs::path(cp);
+
+	auto pw = getpwuid(getuid());
+	if (pw) return fs::path(pw->pw_dir);
+
+	return fs::path();
+}
+
+
+fs::path root();
+
+namespace {
+
+	fs::path find_root() {
+
+		static const std::array<filesystem::path, 2> locations = { {
+			"/usr/share/mpw/",
+			"/usr/local/share/mpw/"
+		} };
+
+		std::error_code ec;
+		fs::path p;
+
+		p = home();
+		if (!p.empty()) {
+			p /= "mpw/";
+			if (fs::is_directory(p, ec)) return p;
+		}
+		for (fs::path p : locations) {
+			p /= "mpw/";
+			if (fs::is_directory(p, ec)) return p;
+		}
+
+		fprintf(stderr, "### Warning: Unable to find mpw directory.\n");
+		return fs::path();
+	}
+
+	fs::path find_mpw() {
+
+		std::error_code ec;
+		const char *cp = getenv("PATH");
+		if (!cp) cp = _PATH_DEFPATH;
+		std::string s(cp);
+		string_splitter ss(s, ':');
+		for (; ss; ++ss) {
+			if (ss->empty()) continue;
+			fs::path p(*ss);
+			p /= "mpw";
+
+			if (fs::is_regular_file(p, ec)) return p;
+		}
+		//also check /usr/local/bin
+		fs::path p = "/usr/local/bin/mpw";
+		if (fs::is_regular_file(p, ec)) return p;
+
+		p = root() / "bin/mpw";
+		if (fs::is_regular_file(p, ec)) return p;
+
+		fprintf(stderr, "Unable to find mpw executable\n");
+		fprintf(stderr, "PATH = %s\n", s.c_str());
+		return "mpw";
+	}
+
+}
+
+
+// both are looked up once (thread safe) and never change.
+fs::path root() {
+	static const fs::path root = find_root();
+	return root;
+}
+
+
+int read_file(Environment &e, const std::string &file, const fdmask &fds) {
+	std::error_code ec;
+	const mapped_file mf(file, mapped_file::readonly, ec);
+	if (ec) {
+		echo_flush();
+		fprintf(stderr, "# Error reading %s: %s\n", file.c_str(), ec.message().c_str());
+		return e.status(-1, false);
+	}
+
+
+	mpw_parser p(e, fds);
+	e.status(0, false);
+
+	try {
+		p.parse(mf.begin(), mf.end());
+		p.finish();
+	} catch(const execution_of_input_terminated &ex) {
+		return ex.status();
+	}
+	return e.status();
+}
+
+
+int read_string(Environment &e, const std::string &s, const fdmask &fds) {
+	mpw_parser p(e, fds);
+	e.status(0, false);
+	try {
+		p.parse(s);
+		p.finish();
+	} catch(const execution_of_input_terminated &ex) {
+		return ex.status();
+	}
+	return e.status();
+
+}
+
+
+int read_fd(Environment &e, int fd, const fdmask &fds) {
+
+	unsigned char buffer[2048];
+	ssize_t size;
+
+	mpw_parser p(e, fds);
+	e.status(0, false);
+
+	try {
+		for (;;) {
+			size = read(fd, buffer, sizeof(buffer));
+			if (size < 0) {
+				if (errno == EINTR) continue;
+				perror("read");
+				e.status(-1, false);
+			}
+			if (size == 0) break;
+			p.parse(buffer, buffer + size);
+		}
+		p.finish();
+	} catch(const execution_of_input_terminated &ex) {
+		return ex.status();
+	}
+	return e.status();
+}
+
+fs::path mpw_path() {
+	static const fs::path path = find_mpw();
+	return path;
+}
+
+// -Dname or -Dname=value
+void define(Environment &env, const std::string &s) {
+
+	auto pos = s.find('=');
+	if (pos == s.npos) env.set(s, 1);
+	else {
+		std::string k = s.substr(0, pos);
+		std::string v = s.substr(pos+1);
+		env.set(k, v);
+	}
+
+}
@@ -4,6 +4,8 @@
 
 #include "mpw-shell.h"
 #include "error.h"
+#include "profile.h"
+#include "alloc_stats.h"
 
 %%{
 	machine  tokenizer;
@@ -266,6 +268,8 @@ void unquote(token &t) {
 
 std::vector<token> tokenize(std::string &s, bool eval)
 {
+	profile_span span("tokenize", "tokenize");
+	alloc_stage stage(ALLOC_TOKENIZE);
 	std::vector<token> tokens;
 	std::string scratch;
 
@@ -4,15 +4,19 @@
 #include <unordered_map>
 #include <atomic>
 #include <algorithm>
+#include <memory>
 
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <cerrno>
+#include <climits>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <getopt.h>
+#include <chrono>
 
 #include "mpw-shell.h"
 #include "mpw_parser.h"
@@ -26,6 +30,14 @@
 #include "cxx/string_splitter.h"
 
 #include "error.h"
+#include "echo_buffer.h"
+#include "profile.h"
+#include "resource_usage.h"
+#include "native_make.h"
+#include "build_export.h"
+#include "file_watcher.h"
+#include "shell_server.h"
+#include "batch.h"
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -39,55 +51,17 @@
 
 namespace fs = filesystem;
 
-bool utf8 = false;
-
-fs::path home() {
-
-	const char *cp = getenv("HOME");
-	if (cp && cp) {
-		auto pw = getpwuid(getuid());
-		if (pw) return fs::path(pw->pw_dir);
-
-	}
-	return fs::path();
+namespace ToolBox {
+	std::string MacToUnix(const std::string path);
+	std::string UnixToMac(const std::string path);
 }
 
+bool utf8 = false;
 
-fs::path root() {
-
-	static fs::path root;
-	bool init = false;
-
-	static std::array<filesystem::path, 2> locations = { {
-		"/usr/share/mpw/",
-		"/usr/local/share/mpw/"
-	} };
-
-	if (!init) {
-		init = true;
-		std::error_code ec;
-		fs::path p;
-
-		p = home();
-		if (!p.empty()) {
-			p /= "mpw/";
-			if (fs::is_directory(p, ec)) {
-				root = std::move(p);
-				return root;
-			}
-		}
-		for (fs::path p : locations) {
-			p /= "mpw/";
-			if (fs::is_directory(p, ec)) {
-				root = std::move(p);
-				return root;
-			}
-		}
+fs::path root();
+fs::path mpw_path();
+extern std::atomic<int> control_c;
 
-		fprintf(stderr, "### Warning: Unable to find mpw directory.\n");
-	}
-	return root;
-}
 // should set {MPW}, {MPWVersion}, then execute {MPW}StartUp
 void init(Environment &env) {
 
@@ -99,68 +73,6 @@ void init(Environment &env) {
 
 
 
-int read_file(Environment &e, const std::string &file, const fdmask &fds) {
-	std::error_code ec;
-	const mapped_file mf(file, mapped_file::readonly, ec);
-	if (ec) {
-		fprintf(stderr, "# Error reading %s: %s\n", file.c_str(), ec.message().c_str());
-		return e.status(-1, false);
-	}
-
-
-	mpw_parser p(e, fds);
-	e.status(0, false);
-
-	try {
-		p.parse(mf.begin(), mf.end());
-		p.finish();
-	} catch(const execution_of_input_terminated &ex) {
-		return ex.status();
-	}
-	return e.status();
-}
-
-
-int read_string(Environment &e, const std::string &s, const fdmask &fds) {
-	mpw_parser p(e, fds);
-	e.status(0, false);
-	try {
-		p.parse(s);
-		p.finish();
-	} catch(const execution_of_input_terminated &ex) {
-		return ex.status();
-	}
-	return e.status();
-
-}
-
-
-int read_fd(Environment &e, int fd, const fdmask &fds) {
-
-	unsigned char buffer[2048];
-	ssize_t size;
-
-	mpw_parser p(e, fds);
-	e.status(0, false);
-
-	try {
-		for (;;) {
-			size = read(fd, buffer, sizeof(buffer));
-			if (size < 0) {
-				if (errno == EINTR) continue;
-				perror("read");
-				e.status(-1, false);
-			}
-			if (size == 0) break;
-			p.parse(buffer, buffer + size);
-		}
-		p.finish();
-	} catch(const execution_of_input_terminated &ex) {
-		return ex.status();
-	}
-	return e.status();
-}
-
 void launch_mpw(const Environment &env, const std::vector<std::string> &argv, const fdmask &fds);
 fs::path which(const Environment &env, const std::string &name);
 
@@ -181,6 +93,8 @@ int read_make(Environment &env, const std::vector<std::string> &argv) {
 	fcntl(out[0], F_SETFD, FD_CLOEXEC);
 	fcntl(out[1], F_SETFD, FD_CLOEXEC);
 
+	echo_flush();
+	auto wall = std::chrono::steady_clock::now();
 	int child = fork();
 	if (child < 0) {
 		perror("fork");
@@ -203,13 +117,17 @@ int read_make(Environment &env, const std::vector<std::string> &argv) {
 	// check for make errors.
 	for(;;) {
 		int status;
-		int ok = waitpid(child, &status, 0);
+		struct rusage ru;
+		int ok = wait4(child, &status, 0, &ru);
 		if (ok < 0) {
 			if (errno == EINTR) continue;
-			perror("waitpid: ");
+			perror("wait4: ");
 			exit(EX_OSERR);
 		}
 
+		auto elapsed = std::chrono::steady_clock::now() - wall;
+		env.add_usage(resource_usage(ru, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+
 		if (WIFEXITED(status)) {
 			ok = WEXITSTATUS(status);
 			env.status(ok, false);
@@ -227,7 +145,6 @@ int read_make(Environment &env, const std::vector<std::string> &argv) {
 	return rv;
 }
 
-std::atomic<int> control_c{0};
 void control_c_handler(int signal, siginfo_t *sinfo, void *context) {
 
 	// libedit gobbles up the first control-C and doesn't return until the second.
@@ -261,6 +178,7 @@ int interactive(Environment &env) {
 	for(;;) {
 		const char *prompt = "# ";
 		if (p.continuation()) prompt = "> ";
+		echo_flush();
 		char *cp = readline(prompt);
 		if (!cp) {
 			if (control_c) {
@@ -309,25 +227,26 @@ void help() {
 
 	_("MPW Shell " VERSION " (" VERSION_DATE ")");
 	_("mpw-shell [option...]");
+	_("mpw-shell -B [-j jobs] [option...] script|@manifest...");
+	_("    -B                      # run the scripts at the same time");
 	_("    -c string               # read commands from string");
 	_("    -d name[=value]         # define variable name");
 	_("    -f                      # don't load MPW:Startup file");
 	_("    -h                      # display help information");
+	_("    -j jobs                 # with -B, scripts to run at once ({ParallelJobs})");
+	_("    -P file                 # write a chrome trace profile to file");
+	_("    -s socket               # run -c or stdin in a server, if there is one");
+	_("    -S socket               # start a server (after Startup)");
 	_("    -v                      # be verbose (echo = 1)");
 
 #undef _
 }
 
-void define(Environment &env, const std::string &s) {
-
-	auto pos = s.find('=');
-	if (pos == s.npos) env.set(s, 1);
-	else {
-		std::string k = s.substr(0, pos);
-		std::string v = s.substr(pos+1);
-		env.set(k, v);
-	}
-
+// -P file overrides {Profile}
+void init_profile(const Environment &env) {
+	if (profiling) return;
+	std::string s = env.get("profile");
+	if (!s.empty()) profile_start(ToolBox::MacToUnix(s));
 }
 
 /*
@@ -359,9 +278,79 @@ void make_help(void) {
 	_("");
 	_("    --help                  # display help");
 	_("    --dry-run, --test       # show what commands would run");
+	_("    --native                # don't run the Make tool (no -r, -s, -t or -u)");
+	_("    --stat-cache            # with --native, save file dates between runs");
+	_("    --export dir            # write dir/build.ninja and dir/compile_commands.json");
+	_("    --watch                 # with --native, rebuild whenever a file changes");
+	_("    --profile file          # write a chrome trace profile to file");
 #undef _
 }
 
+/*
+ * mpw-make --watch.  Startup runs once and the native make's stat cache
+ * stays in memory; after each build, the makefiles, targets and
+ * prerequisites are watched and only the files that changed are stat-ed
+ * again.  {MakeWatchDelay} is the quiet period (ms) before a rebuild.
+ */
+int watch_make(const Environment &env, const std::vector<std::string> &args, bool dry_run) {
+
+	native_make_state state;
+	file_watcher watcher;
+	std::vector<std::string> argv(args.begin() + 1, args.end());
+
+	unsigned delay = 100;
+	std::string s = env.get("makewatchdelay");
+	if (!s.empty()) delay = strtoul(s.c_str(), nullptr, 10);
+
+	// the makefiles' directories are watched before anything else happens.
+	std::vector<std::string> makefiles;
+	for (size_t i = 0; i + 1 < argv.size(); ++i)
+		if (argv[i] == "-f") makefiles.push_back(ToolBox::MacToUnix(argv[++i]));
+	if (makefiles.empty()) makefiles.push_back("MakeFile");
+	watcher.watch(makefiles);
+
+	for(;;) {
+		std::string script;
+		int rv;
+		{
+			profile_span span("make", "native");
+			rv = native_make(env, argv, script, &state);
+		}
+
+		// before the build runs, so edits made during it aren't lost.
+		watcher.watch(state.files);
+
+		if (rv == 0 && !script.empty()) {
+			if (dry_run) {
+				fwrite(script.data(), 1, script.size(), stdout);
+				fflush(stdout);
+			}
+			else {
+				// each build gets a fresh copy of the Startup environment.
+				Environment e(env);
+				e.set("echo", 1);
+				e.set("exit", 1);
+				try {
+					read_string(e, script);
+				} catch (const exit_command_t &) {}
+				echo_flush();
+			}
+		}
+
+		// the build's own outputs -- make again (quietly) until nothing moves.
+		auto changed = watcher.pending();
+		if (changed.empty()) {
+			fprintf(stderr, "# mpw-make - watching %zu files%s\n", state.files.size(), watcher.polling() ? " (polling)" : "");
+			changed = watcher.wait(delay);
+			auto elapsed = std::chrono::steady_clock::now() - watcher.first_event();
+			fprintf(stderr, "# mpw-make - %zu changed, rebuilding (%.1f ms after the first change)\n",
+				changed.size(),
+				std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / 1000.0);
+		}
+		for (const auto &p : changed) state.cache.invalidate(p);
+	}
+}
+
 int make(int argc, char **argv) {
 
 	Environment e;
@@ -371,12 +360,20 @@ int make(int argc, char **argv) {
 	args.reserve(argc+1);
 	int c;
 	bool passthrough = false;
+	bool native = false;
+	std::string export_dir;
+	bool watch = false;
 
 	static struct option longopts[] = {
 		{ "help",    no_argument, nullptr, 'h' },
 		{ "verbose", no_argument, nullptr, 'v' },
 		{ "test",    no_argument, nullptr, 1 },
 		{ "dry-run", no_argument, nullptr, 2 },
+		{ "profile", required_argument, nullptr, 3 },
+		{ "native",  no_argument, nullptr, 4 },
+		{ "stat-cache", no_argument, nullptr, 5 },
+		{ "export",  required_argument, nullptr, 6 },
+		{ "watch",   no_argument, nullptr, 7 },
 		{ nullptr, 0, nullptr, 0},
 	};
 
@@ -401,6 +398,26 @@ int make(int argc, char **argv) {
 				passthrough = true;
 				break;
 
+			case 3:
+				profile_start(optarg);
+				break;
+
+			case 4:
+				native = true;
+				break;
+
+			case 5:
+				e.set("makestatcache", 1);
+				break;
+
+			case 6:
+				export_dir = optarg;
+				break;
+
+			case 7:
+				watch = true;
+				break;
+
 			case 'd':
 			case 'f':
 			case 'i':
@@ -436,9 +453,46 @@ int make(int argc, char **argv) {
 
 
 
+	init_profile(e);
 	e.startup(true);
 	read_file(e, root() / "Startup");
 	e.startup(false);
+	init_profile(e);
+
+	if (watch) {
+		if (!native_make_supported(args)) {
+			fputs("### MPW Shell - --watch can't be used with -r, -s, -t or -u.\n", stderr);
+			return EX_USAGE;
+		}
+		return watch_make(e, args, passthrough);
+	}
+
+	// --export -- external commands are recorded, not run.
+	std::unique_ptr<build_export> exporter;
+	if (!export_dir.empty() && !passthrough) exporter.reset(new build_export);
+	auto finish = [&](int rv) {
+		if (!exporter) return rv;
+		if (!exporter->write(export_dir)) return rv ? rv : 1;
+		fprintf(stderr, "# %zu commands written to %s\n", exporter->size(), export_dir.c_str());
+		return rv;
+	};
+
+	if (native && native_make_supported(args)) {
+		std::string script;
+		int rv;
+		{
+			profile_span span("make", "native");
+			rv = native_make(e, std::vector<std::string>(args.begin() + 1, args.end()), script);
+		}
+		if (rv) return rv;
+		if (passthrough) {
+			fwrite(script.data(), 1, script.size(), stdout);
+			return 0;
+		}
+		e.set("echo", 1);
+		e.set("exit", 1);
+		return finish(read_string(e, script));
+	}
 
 	auto path = which(e, "Make");
 	if (path.empty()) {
@@ -454,55 +508,10 @@ int make(int argc, char **argv) {
 		exit(EX_OSERR);
 	}
 
-	return read_make(e, args);
+	return finish(read_make(e, args));
 
 }
 
-fs::path mpw_path() {
-
-	static fs::path path;
-
-	if (path.empty()) {
-		std::error_code ec;
-		const char *cp = getenv("PATH");
-		if (!cp) cp = _PATH_DEFPATH;
-		std::string s(cp);
-		string_splitter ss(s, ':');
-		for (; ss; ++ss) {
-			if (ss->empty()) continue;
-			fs::path p(*ss);
-			p /= "mpw";
-
-			if (fs::is_regular_file(p, ec)) {
-				path = std::move(p);
-				break;
-			}
-		}
-		//also check /usr/local/bin
-		if (path.empty()) {
-			fs::path p = "/usr/local/bin/mpw";
-			if (fs::is_regular_file(p, ec)) {
-				path = std::move(p);
-			}
-		}
-
-		if (path.empty()) {
-			fs::path p = root() / "bin/mpw";
-			if (fs::is_regular_file(p, ec)) {
-				path = std::move(p);
-			}
-		}
-
-		if (path.empty()) {
-			fprintf(stderr, "Unable to find mpw executable\n");
-			fprintf(stderr, "PATH = %s\n", s.c_str());
-			path = "mpw";
-		}
-	}
-
-	return path;
-}
-
 void init_locale() {
 
 	/*
@@ -528,23 +537,27 @@ int main(int argc, char **argv) {
 
 	init_locale();
 
-	mpw_path();
-
 	fs::path self = fs::path(argv[0]).filename();
-	if (self == "mpw-make") return make(argc, argv);
+	if (self == "mpw-make") { mpw_path(); return make(argc, argv); }
 	if (self == "mpw-shell" && argc > 1 && !strcmp(argv[1],"make")) {
+		mpw_path();
 		argv[1] = (char *)"mpw-make";
 		return make(argc - 1, argv + 1);
 	}
-	
-	Environment e;
-	init(e);
 
 	const char *cflag = nullptr;
 	bool fflag = false;
+	bool profile = false;
+	bool bflag = false;
+	unsigned jobs = 0;
+	std::vector<std::string> defines;
+	std::string client_socket;
+	std::string server_socket;
+
+	if (const char *cp = getenv("MPW_SHELL_SOCKET")) client_socket = cp;
 
 	int c;
-	while ((c = getopt(argc, argv, "c:D:vhf")) != -1) {
+	while ((c = getopt(argc, argv, "Bc:D:vhfj:P:s:S:")) != -1) {
 		switch (c) {
 			case 'c':
 				// -c command
@@ -552,15 +565,31 @@ int main(int argc, char **argv) {
 				break;
 			case 'D':
 				// -Dname or -Dname=value
-				define(e, optarg);
+				defines.push_back(optarg);
 				break;
 			case 'v':
 				// -v verbose
-				e.set("echo", "1");
+				defines.push_back("echo=1");
+				break;
+			case 's':
+				client_socket = optarg;
+				break;
+			case 'S':
+				server_socket = optarg;
+				break;
+			case 'B':
+				bflag = true;
+				break;
+			case 'j':
+				jobs = strtoul(optarg, nullptr, 10);
 				break;
 			case 'f':
 				fflag = true;
 				break;
+			case 'P':
+				profile_start(optarg);
+				profile = true;
+				break;
 			case 'h':
 				help();
 				exit(0);
@@ -575,7 +604,26 @@ int main(int argc, char **argv) {
 
 
 
-	if (!cflag) fprintf(stdout, "MPW Shell " VERSION "\n");
+	// the server has already done the startup work (so -f can't be forwarded).
+	if (!client_socket.empty() && server_socket.empty() && !bflag && !fflag && !profile && (cflag || !isatty(STDIN_FILENO))) {
+		shell_request rq;
+		char cwd[PATH_MAX];
+		if (getcwd(cwd, sizeof(cwd))) rq.directory = cwd;
+		rq.defines = defines;
+		if (cflag) rq.command = cflag;
+		else rq.use_stdin = true;
+		int rv;
+		if (shell_forward(client_socket, rq, rv)) exit(rv);
+	}
+
+	mpw_path();
+
+	Environment e;
+	init(e);
+	for (const auto &d : defines) define(e, d);
+
+	if (!cflag && !bflag && server_socket.empty()) fprintf(stdout, "MPW Shell " VERSION "\n");
+	init_profile(e);
 	if (!fflag) {
 		fs::path startup = root() / "Startup";
 		e.startup(true);
@@ -584,11 +632,23 @@ int main(int argc, char **argv) {
 		try {
 			read_file(e, startup);
 		} catch (const std::system_error &ex) {
+			echo_flush();
 			fprintf(stderr, "### %s: %s\n", startup.c_str(), ex.what());
 		} catch (const quit_command_t &) {
 		}
 
 		e.startup(false);
+		init_profile(e);
+	}
+
+	if (!server_socket.empty()) exit(shell_serve(e, server_socket));
+
+	if (bflag) {
+		if (optind == argc) {
+			help();
+			exit(EX_USAGE);
+		}
+		exit(run_batch(e, std::vector<std::string>(argv + optind, argv + argc), jobs));
 	}
 
 	try {
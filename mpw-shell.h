@@ -72,5 +72,8 @@ int read_file(Environment &e, const std::string &file, const fdmask &fds = fdmas
 int read_string(Environment &e, const std::string &s, const fdmask &fds = fdmask());
 int read_fd(Environment &e, int fd, const fdmask &fds = fdmask());
 
+// -Dname or -Dname=value
+void define(Environment &env, const std::string &s);
+
 
 #endif
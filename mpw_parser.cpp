@@ -5,16 +5,22 @@
 
 #include "command.h"
 #include "error.h"
+#include "echo_buffer.h"
+#include "profile.h"
+#include "alloc_stats.h"
 
 mpw_parser::mpw_parser(Environment &e, fdmask fds, bool interactive) : _env(e), _fds(fds), _interactive(interactive)
 {
 
 	_p3 = phase3::make();
 	_p2.set_next([this](int type, std::string &&s){
+		profile_span span("parse", "phase3");
+		ast_arena::scope scope(_arena);
 		_p3->parse(type, std::move(s));
 	});
 
 	_p1.set_next([this](std::string &&s){
+		profile_span span("parse", "phase2");
 		_p2.parse(std::move(s));
 	});
 }
@@ -33,9 +39,13 @@ bool mpw_parser::continuation() const {
 }
 
 void mpw_parser::finish() {
-	_p1.finish();
-	_p2.finish();
-	_p3->parse(0, "");
+	{
+		alloc_stage stage(ALLOC_PARSE);
+		_p1.finish();
+		_p2.finish();
+		ast_arena::scope scope(_arena);
+		_p3->parse(0, "");
+	}
 
 	// and now execute the commands...
 	execute();
@@ -60,7 +70,11 @@ void mpw_parser::abort() {
 
 void mpw_parser::parse(const void *begin, const void *end) {
 	if (_abort) return;
-	_p1.parse((const unsigned char *)begin, (const unsigned char *)end);
+	{
+		profile_span span("parse", "phase1");
+		alloc_stage stage(ALLOC_PARSE);
+		_p1.parse((const unsigned char *)begin, (const unsigned char *)end);
+	}
 
 	// and execute...
 	execute();
@@ -95,6 +109,7 @@ void mpw_parser::execute() {
 
 		if (_interactive) {
 			if (!cmd->terminal() || !commands.empty()) {
+				echo_flush();
 				if (ex.status()) fprintf(stderr, "### %s\n", ex.what());
 			}
 			return;
@@ -9,6 +9,7 @@
 
 #include "phase1.h"
 #include "phase2.h"
+#include "ast_arena.h"
 
 class mpw_parser {
 
@@ -34,6 +35,9 @@ public:
 
 	bool continuation() const;
 
+	// the command tree's memory.
+	const ast_arena &arena() const noexcept { return _arena; }
+
 private:
 
 	mpw_parser& operator=(const mpw_parser &) = delete;
@@ -49,6 +53,9 @@ private:
 	bool _interactive = false;
 	bool _abort = false;
 
+	// before _p3 so it outlives the nodes on the parser stack.
+	ast_arena _arena;
+
 	phase1 _p1;
 	phase2 _p2;
 	std::unique_ptr<class phase3> _p3;
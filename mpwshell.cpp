@@ -0,0 +1,84 @@
+#include "mpwshell.h"
+#include "mpw-shell.h"
+#include "environment.h"
+#include "fdset.h"
+#include "error.h"
+#include "echo_buffer.h"
+
+#include <cstdio>
+
+#include "cxx/filesystem.h"
+
+namespace fs = filesystem;
+
+fs::path root();
+
+namespace mpwshell {
+
+	shell::shell() : _env(new Environment) {
+		_env->control_c(_control_c);
+		_env->set("mpw", root());
+		_env->set("status", 0);
+		_env->set("exit", 1);
+		_env->set("echo", 1);
+	}
+
+	shell::~shell() {
+		echo_flush();
+	}
+
+
+	template<class F>
+	int shell::run(F &&fx) {
+		_control_c = 0;
+		int rv;
+		try {
+			rv = fx();
+		} catch (const quit_command_t &) {
+			rv = 0;
+		} catch (const exit_command_t &ex) {
+			rv = ex.value;
+		} catch (const mpw_error &ex) {
+			echo_flush();
+			fprintf(stderr, "### %s\n", ex.what());
+			rv = ex.status();
+		}
+		echo_flush();
+		return rv;
+	}
+
+
+	int shell::startup() {
+		fs::path path = root() / "Startup";
+		_env->startup(true);
+		int rv = run([&](){ return read_file(*_env, path); });
+		_env->startup(false);
+		return rv;
+	}
+
+	int shell::run_string(const std::string &script, const fds &f) {
+		return run([&](){ return read_string(*_env, script, fdmask(f.in, f.out, f.err)); });
+	}
+
+	int shell::run_file(const std::string &path, const fds &f) {
+		return run([&](){ return read_file(*_env, path, fdmask(f.in, f.out, f.err)); });
+	}
+
+	int shell::run_fd(int fd, const fds &f) {
+		return run([&](){ return read_fd(*_env, fd, fdmask(f.in, f.out, f.err)); });
+	}
+
+
+	std::string shell::get(const std::string &name) const {
+		return _env->get(name);
+	}
+
+	void shell::set(const std::string &name, const std::string &value, bool exported) {
+		_env->set(name, value, exported);
+	}
+
+	void shell::define(const std::string &s) {
+		::define(*_env, s);
+	}
+
+}
@@ -0,0 +1,81 @@
+#ifndef __mpwshell_h__
+#define __mpwshell_h__
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+/*
+ * libmpwshell -- the shell without main().
+ *
+ *	mpwshell::shell sh;
+ *	sh.startup();
+ *	int status = sh.run_string("Set x 1; Echo {x}\n", { -1, fd, fd });
+ *	std::string x = sh.get("x");
+ *
+ * each shell has its own variables, aliases and ^C flag, so several can run
+ * on different threads.  a single shell is not thread safe, except for
+ * interrupt().  some state is still process-wide:
+ *
+ *	- the current directory (Directory changes it for every shell)
+ *	- the profiler
+ *	- the MPW directory and mpw executable, found once on first use
+ *	- Echo output goes to one queue; lines from different shells interleave
+ *	- external commands block SIGINT in the calling thread while they run
+ *
+ * commands run in forked children (external tools, parallel loops), so the
+ * host should not rely on fork-unsafe locks held by other threads.
+ */
+
+class Environment;
+
+namespace mpwshell {
+
+	// -1 means the process's own stdin, stdout or stderr.
+	struct fds {
+		int in = -1;
+		int out = -1;
+		int err = -1;
+	};
+
+	class shell {
+	public:
+
+		// {MPW}, {Status}, {Exit} and {Echo} are set as in mpw-shell.
+		shell();
+		~shell();
+
+		shell(const shell &) = delete;
+		shell &operator=(const shell &) = delete;
+
+		// runs {MPW}Startup.  returns its status.
+		int startup();
+
+		// these return the script's status.  Exit and Quit stop the script
+		// but not the host.
+		int run_string(const std::string &script, const fds &f = fds());
+		int run_file(const std::string &path, const fds &f = fds());
+		int run_fd(int fd, const fds &f = fds());
+
+		std::string get(const std::string &name) const;
+		void set(const std::string &name, const std::string &value, bool exported = false);
+		void define(const std::string &s); // name or name=value
+
+		// like ^C -- the running script stops at the next command.
+		void interrupt() noexcept { ++_control_c; }
+
+		// the underlying environment, for anything else.
+		Environment &environment() noexcept { return *_env; }
+		const Environment &environment() const noexcept { return *_env; }
+
+	private:
+		template<class F>
+		int run(F &&fx);
+
+		std::atomic<int> _control_c{0};
+		std::unique_ptr<Environment> _env;
+	};
+
+}
+
+#endif
@@ -0,0 +1,739 @@
+#include "native_make.h"
+#include "environment.h"
+#include "mpw-shell.h"
+#include "error.h"
+#include "stat_cache.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+#include <sys/stat.h>
+
+#include "cxx/mapped_file.h"
+
+namespace ToolBox {
+	std::string MacToUnix(const std::string path);
+}
+
+namespace {
+
+	/*
+	 * ƒ and ∂ may be MacRoman (0xc4 / 0xb6) or utf-8.
+	 */
+	size_t match_char(const std::string &s, size_t i, unsigned char mac, const char *utf8) {
+		if ((unsigned char)s[i] == mac) return 1;
+		size_t n = strlen(utf8);
+		if (s.compare(i, n, utf8) == 0) return n;
+		return 0;
+	}
+
+	size_t is_f(const std::string &s, size_t i) {
+		return match_char(s, i, 0xc4, "\xc6\x92");
+	}
+
+	size_t is_escape(const std::string &s, size_t i) {
+		return match_char(s, i, 0xb6, "\xe2\x88\x82");
+	}
+
+	bool is_space(unsigned char c) {
+		return c == ' ' || c == '\t';
+	}
+
+	void lowercase(std::string &s) {
+		std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c){ return tolower(c); });
+	}
+
+	std::string trim(const std::string &s) {
+		size_t begin = 0;
+		size_t end = s.size();
+		while (begin < end && is_space(s[begin])) ++begin;
+		while (end > begin && is_space(s[end-1])) --end;
+		return s.substr(begin, end - begin);
+	}
+
+	bool ends_with(const std::string &s, const std::string &suffix) {
+		if (s.size() < suffix.size()) return false;
+		return strcasecmp(s.c_str() + s.size() - suffix.size(), suffix.c_str()) == 0;
+	}
+
+
+	/*
+	 * walks a line, skipping quoted text and ∂ escapes.  fx is called with
+	 * the offset of each unquoted character and returns false to stop.
+	 */
+	template<class FX>
+	void scan(const std::string &s, FX &&fx) {
+		char q = 0;
+		for (size_t i = 0; i < s.size(); ) {
+			char c = s[i];
+			if (q) {
+				if (c == q) q = 0;
+				else if (q == '"') {
+					size_t n = is_escape(s, i);
+					if (n) { i += n + 1; continue; }
+				}
+				++i;
+				continue;
+			}
+			size_t n = is_escape(s, i);
+			if (n) { i += n + 1; continue; }
+			if (c == '\'' || c == '"') { q = c; ++i; continue; }
+			if (!fx(i)) return;
+			++i;
+		}
+	}
+
+	void strip_comment(std::string &s) {
+		size_t pos = std::string::npos;
+		scan(s, [&](size_t i){
+			// {#} is a variable, not a comment.
+			if (s[i] == '#' && (i == 0 || s[i-1] != '{')) { pos = i; return false; }
+			return true;
+		});
+		if (pos != std::string::npos) s.resize(pos);
+		while (!s.empty() && is_space(s.back())) s.pop_back();
+	}
+
+	std::vector<std::string> split_words(const std::string &s) {
+		std::vector<std::string> words;
+		size_t begin = std::string::npos;
+		scan(s, [&](size_t i){
+			if (is_space(s[i])) {
+				if (begin != std::string::npos) words.emplace_back(s.substr(begin, i - begin));
+				begin = std::string::npos;
+			}
+			else if (begin == std::string::npos) begin = i;
+			return true;
+		});
+		if (begin != std::string::npos) words.emplace_back(s.substr(begin));
+		return words;
+	}
+
+	std::string unquote(const std::string &s) {
+		std::string rv;
+		char q = 0;
+		for (size_t i = 0; i < s.size(); ) {
+			char c = s[i];
+			if (q != '\'') {
+				size_t n = is_escape(s, i);
+				if (n) {
+					i += n;
+					if (i < s.size()) rv.push_back(s[i++]);
+					continue;
+				}
+			}
+			if (q) {
+				if (c == q) q = 0;
+				else rv.push_back(c);
+			}
+			else if (c == '\'' || c == '"') q = c;
+			else rv.push_back(c);
+			++i;
+		}
+		return rv;
+	}
+
+	std::string join(const std::vector<std::string> &v) {
+		std::string rv;
+		for (const auto &s : v) {
+			if (!rv.empty()) rv.push_back(' ');
+			rv += quote(s);
+		}
+		return rv;
+	}
+
+
+	struct line {
+		std::string text;
+		unsigned number;
+	};
+
+	/*
+	 * split into lines (cr, lf or crlf) and join ∂-continued lines.
+	 */
+	std::vector<line> read_lines(const std::string &text) {
+		std::vector<line> lines;
+		std::string s;
+		unsigned number = 1;
+		unsigned first = 1;
+
+		for (size_t i = 0; i < text.size(); ) {
+			char c = text[i];
+			if (c == '\r' || c == '\n') {
+				if (c == '\r' && i + 1 < text.size() && text[i+1] == '\n') ++i;
+				++i;
+				lines.push_back({std::move(s), first});
+				s.clear();
+				first = ++number;
+				continue;
+			}
+			size_t n = is_escape(text, i);
+			if (n) {
+				size_t j = i + n;
+				if (j < text.size() && (text[j] == '\r' || text[j] == '\n')) {
+					if (text[j] == '\r' && j + 1 < text.size() && text[j+1] == '\n') ++j;
+					i = j + 1;
+					++number;
+					continue;
+				}
+				s.append(text, i, n);
+				if (j < text.size()) s.push_back(text[j++]);
+				i = j;
+				continue;
+			}
+			s.push_back(c);
+			++i;
+		}
+		if (!s.empty()) lines.push_back({std::move(s), first});
+		return lines;
+	}
+
+
+	struct rule {
+		std::vector<std::string> deps;
+		std::vector<std::string> commands;
+	};
+
+	struct default_rule {
+		std::string target_suffix;
+		std::string dep_suffix;
+		std::vector<std::string> commands;
+	};
+
+	struct target {
+		std::vector<std::string> deps;
+		std::vector<std::string> commands;
+		std::deque<rule> rules; // ƒƒ
+		bool double_f = false;
+		bool single_f = false;
+
+		// default rule variables.
+		std::string default_name;
+		std::string dep_dir;
+		std::string targ_dir;
+
+		enum { pending, active, done };
+		int state = pending;
+		bool exists = false;
+		bool rebuilt = false;
+		time_t mtime = 0;
+	};
+
+
+	class makefile {
+	public:
+
+		makefile(const Environment &env, stat_cache &cache) : cache(cache), _env(env)
+		{
+			_builtin_defaults.push_back({".c.o", ".c", {"C {DepDir}{Default}.c {COptions} -o {TargDir}{Default}.c.o"}});
+			_builtin_defaults.push_back({".a.o", ".a", {"Asm {DepDir}{Default}.a {AOptions} -o {TargDir}{Default}.a.o"}});
+			_builtin_defaults.push_back({".p.o", ".p", {"Pascal {DepDir}{Default}.p {POptions} -o {TargDir}{Default}.p.o"}});
+		}
+
+		void define(const std::string &name, const std::string &value, bool fixed);
+		void read(const std::string &name);
+		void make(const std::string &name);
+
+		const std::string &first_target() const { return _first; }
+		const std::string &script() const { return _out; }
+		std::vector<std::string> targets() const;
+		std::vector<std::string> rebuilt() const;
+
+		std::vector<std::string> include_dirs;
+		bool everything = false;
+		bool progress = false;
+		bool verbose = false;
+		bool quiet_current = false;
+		bool warnings = true;
+
+		// every target and prerequisite is looked up here.
+		stat_cache &cache;
+
+		// every makefile read, including Include files.
+		std::vector<std::string> makefiles;
+
+	private:
+
+		typedef std::map<std::string, std::string> locals_type;
+
+		std::string expand(const std::string &s, const locals_type *locals = nullptr) const;
+		void parse(const std::string &file, const std::vector<line> &lines);
+		void parse_rule(const std::string &left, const std::string &right, bool double_f, std::vector<std::vector<std::string> *> &commands);
+
+		bool apply_default(const std::string &name, target &t);
+		bool can_make(const std::string &name);
+		std::vector<std::string> newer(const target &t, const std::vector<std::string> &deps);
+		void emit(const std::string &name, const target &t, const rule &r, const std::vector<std::string> &newer);
+
+		const Environment &_env;
+		std::map<std::string, std::string> _vars;
+		std::set<std::string> _fixed;
+		std::map<std::string, target> _targets;
+		std::deque<default_rule> _defaults;
+		std::vector<default_rule> _builtin_defaults;
+		std::map<std::string, std::vector<std::string>> _dirs;
+		std::string _first;
+		std::string _out;
+		std::vector<std::string> _files;
+	};
+
+
+	void makefile::define(const std::string &name, const std::string &value, bool fixed) {
+		std::string k(name);
+		lowercase(k);
+		if (!fixed && _fixed.count(k)) return;
+		if (fixed) _fixed.insert(k);
+		_vars[k] = value;
+	}
+
+
+	/*
+	 * {name} is replaced with a make variable or an exported shell variable.
+	 * anything else is left for the shell.
+	 */
+	std::string makefile::expand(const std::string &s, const locals_type *locals) const {
+		std::string rv;
+		rv.reserve(s.size());
+		for (size_t i = 0; i < s.size(); ) {
+			size_t n = is_escape(s, i);
+			if (n) {
+				rv.append(s, i, n);
+				i += n;
+				if (i < s.size()) rv.push_back(s[i++]);
+				continue;
+			}
+			if (s[i] == '{') {
+				size_t end = s.find('}', i + 1);
+				if (end != std::string::npos) {
+					std::string k = s.substr(i + 1, end - i - 1);
+					lowercase(k);
+					const std::string *value = nullptr;
+					if (locals) {
+						auto iter = locals->find(k);
+						if (iter != locals->end()) value = &iter->second;
+					}
+					if (!value) {
+						auto iter = _vars.find(k);
+						if (iter != _vars.end()) value = &iter->second;
+					}
+					if (!value) {
+						auto iter = _env.find(k);
+						if (iter != _env.end() && iter->second) value = &(const std::string &)iter->second;
+					}
+					if (value) {
+						rv += *value;
+						i = end + 1;
+						continue;
+					}
+				}
+			}
+			rv.push_back(s[i++]);
+		}
+		return rv;
+	}
+
+
+	void makefile::read(const std::string &name) {
+
+		std::string path = ToolBox::MacToUnix(name);
+		makefiles.push_back(path);
+		std::error_code ec;
+		const mapped_file mf(path, mapped_file::readonly, ec);
+		if (ec) {
+			struct stat st;
+			// an empty file can't be mapped.
+			if (::stat(path.c_str(), &st) == 0 && st.st_size == 0) return;
+			throw mpw_error(1, "Make - Unable to open \"" + name + "\": " + ec.message());
+		}
+
+		if (std::find(_files.begin(), _files.end(), path) != _files.end())
+			throw mpw_error(1, "Make - \"" + name + "\" is included recursively.");
+		_files.push_back(path);
+
+		std::string text(mf.begin(), mf.end());
+		parse(name, read_lines(text));
+		_files.pop_back();
+	}
+
+
+	void makefile::parse(const std::string &file, const std::vector<line> &lines) {
+
+		// build commands are added to every target on the last dependency line.
+		std::vector<std::vector<std::string> *> commands;
+
+		auto error = [&file](unsigned number, const std::string &message) {
+			return mpw_error(1, "Make - File \"" + file + "\"; Line " + std::to_string(number) + " # " + message);
+		};
+
+		for (const auto &l : lines) {
+			std::string s = l.text;
+			strip_comment(s);
+			if (s.empty()) continue;
+
+			if (is_space(s.front())) {
+				if (commands.empty()) {
+					if (warnings) fprintf(stderr, "### Make - Warning: File \"%s\"; Line %u # command has no target.\n", file.c_str(), l.number);
+					continue;
+				}
+				std::string cmd = trim(s);
+				for (auto *v : commands) v->push_back(cmd);
+				continue;
+			}
+
+			commands.clear();
+
+			size_t f = std::string::npos;
+			size_t flen = 0;
+			size_t eq = std::string::npos;
+			scan(s, [&](size_t i){
+				size_t n = is_f(s, i);
+				if (n) { f = i; flen = n; return false; }
+				if (s[i] == '=' && eq == std::string::npos) eq = i;
+				return true;
+			});
+
+			if (f != std::string::npos) {
+				bool double_f = false;
+				size_t n = f + flen < s.size() ? is_f(s, f + flen) : 0;
+				if (n) { double_f = true; flen += n; }
+				try {
+					parse_rule(s.substr(0, f), s.substr(f + flen), double_f, commands);
+				}
+				catch (const mpw_error &ex) {
+					throw error(l.number, ex.what());
+				}
+				continue;
+			}
+
+			auto words = split_words(s);
+			if (words.size() == 2 && strcasecmp(words[0].c_str(), "include") == 0) {
+				std::string name = unquote(expand(words[1]));
+				std::string found = name;
+				struct stat st;
+				if (::stat(ToolBox::MacToUnix(name).c_str(), &st) != 0) {
+					for (std::string dir : include_dirs) {
+						if (!dir.empty() && dir.back() != ':') dir.push_back(':');
+						std::string tmp = dir + name;
+						if (::stat(ToolBox::MacToUnix(tmp).c_str(), &st) == 0) { found = tmp; break; }
+					}
+				}
+				read(found);
+				continue;
+			}
+
+			if (eq != std::string::npos) {
+				std::string name = trim(s.substr(0, eq));
+				if (!name.empty() && split_words(name).size() == 1) {
+					define(name, expand(trim(s.substr(eq + 1))), false);
+					continue;
+				}
+			}
+
+			throw error(l.number, "unrecognized line: " + s);
+		}
+	}
+
+
+	void makefile::parse_rule(const std::string &left, const std::string &right, bool double_f, std::vector<std::vector<std::string> *> &commands) {
+
+		std::vector<std::string> targets;
+		std::vector<std::string> deps;
+		for (const auto &w : split_words(expand(left))) targets.push_back(unquote(w));
+		for (const auto &w : split_words(expand(right))) deps.push_back(unquote(w));
+
+		if (targets.empty()) throw mpw_error(1, "no target");
+
+		auto is_dir = [](const std::string &s){ return !s.empty() && s.back() == ':'; };
+
+		// :obj: ƒ :src: -- directory dependency rule.
+		if (!deps.empty() && std::all_of(targets.begin(), targets.end(), is_dir) && std::all_of(deps.begin(), deps.end(), is_dir)) {
+			for (const auto &t : targets) {
+				auto &v = _dirs[t];
+				v.insert(v.end(), deps.begin(), deps.end());
+			}
+			return;
+		}
+
+		// .c.o ƒ .c -- default rule.
+		if (targets.size() == 1 && deps.size() == 1 && targets[0].size() > 1 && targets[0][0] == '.' && deps[0][0] == '.' && targets[0].find_first_of(":/") == std::string::npos) {
+			_defaults.push_back({targets[0], deps[0], {}});
+			commands.push_back(&_defaults.back().commands);
+			return;
+		}
+
+		for (const auto &name : targets) {
+			if (_first.empty()) _first = name;
+			target &t = _targets[name];
+			if (double_f) {
+				if (t.single_f) throw mpw_error(1, "\"" + name + "\" is the target of both single and double dependency rules.");
+				t.double_f = true;
+				t.rules.push_back({deps, {}});
+				commands.push_back(&t.rules.back().commands);
+			}
+			else {
+				if (t.double_f) throw mpw_error(1, "\"" + name + "\" is the target of both single and double dependency rules.");
+				t.single_f = true;
+				t.deps.insert(t.deps.end(), deps.begin(), deps.end());
+				// only one ƒ rule may have commands.
+				if (t.commands.empty()) commands.push_back(&t.commands);
+			}
+		}
+	}
+
+
+	std::vector<std::string> makefile::targets() const {
+		std::vector<std::string> rv;
+		rv.reserve(_targets.size());
+		for (const auto &kv : _targets) rv.push_back(ToolBox::MacToUnix(kv.first));
+		return rv;
+	}
+
+
+	// unix paths of the targets the script remakes.
+	std::vector<std::string> makefile::rebuilt() const {
+		std::vector<std::string> rv;
+		for (const auto &kv : _targets)
+			if (kv.second.rebuilt) rv.push_back(ToolBox::MacToUnix(kv.first));
+		return rv;
+	}
+
+
+	bool makefile::can_make(const std::string &name) {
+		auto iter = _targets.find(name);
+		if (iter != _targets.end() && (iter->second.single_f || iter->second.double_f)) return true;
+		stat_cache::entry e;
+		return cache.lookup(ToolBox::MacToUnix(name), e);
+	}
+
+
+	bool makefile::apply_default(const std::string &name, target &t) {
+
+		size_t pos = name.find_last_of(":/");
+		std::string dir = pos == std::string::npos ? "" : name.substr(0, pos + 1);
+		std::string file = pos == std::string::npos ? name : name.substr(pos + 1);
+
+		auto try_rules = [&](const auto &rules) {
+			for (const auto &r : rules) {
+				if (file.size() <= r.target_suffix.size() || !ends_with(file, r.target_suffix)) continue;
+				std::string base = file.substr(0, file.size() - r.target_suffix.size());
+
+				std::vector<std::string> dirs;
+				auto iter = _dirs.find(dir);
+				if (iter != _dirs.end()) dirs = iter->second;
+				else dirs.push_back(dir);
+
+				for (const auto &d : dirs) {
+					std::string dep = d + base + r.dep_suffix;
+					if (!can_make(dep)) continue;
+					t.deps.push_back(dep);
+					t.commands = r.commands;
+					t.default_name = base;
+					t.dep_dir = d;
+					t.targ_dir = dir;
+					return true;
+				}
+			}
+			return false;
+		};
+
+		return try_rules(_defaults) || try_rules(_builtin_defaults);
+	}
+
+
+	std::vector<std::string> makefile::newer(const target &t, const std::vector<std::string> &deps) {
+		std::vector<std::string> rv;
+		for (const auto &d : deps) {
+			const target &dt = _targets[d];
+			if (dt.rebuilt || !dt.exists || dt.mtime > t.mtime) {
+				if (verbose) fprintf(stderr, "#     \"%s\" is newer\n", d.c_str());
+				rv.push_back(d);
+			}
+		}
+		return rv;
+	}
+
+
+	void makefile::emit(const std::string &name, const target &t, const rule &r, const std::vector<std::string> &newer) {
+
+		locals_type locals = {
+			{ "targ", quote(name) },
+			{ "newerdeps", join(newer) },
+			{ "deps", join(r.deps) },
+		};
+		if (!t.default_name.empty()) {
+			locals["default"] = t.default_name;
+			locals["depdir"] = t.dep_dir;
+			locals["targdir"] = t.targ_dir;
+		}
+
+		for (const auto &cmd : r.commands) {
+			_out += expand(cmd, &locals);
+			_out.push_back('\n');
+		}
+	}
+
+
+	void makefile::make(const std::string &name) {
+
+		target &t = _targets[name];
+		if (t.state == target::done) return;
+		if (t.state == target::active)
+			throw mpw_error(1, "Make - Circular dependency: \"" + name + "\" depends on itself.");
+		t.state = target::active;
+
+		if (!t.double_f && t.commands.empty()) apply_default(name, t);
+
+		stat_cache::entry e;
+		if (cache.lookup(ToolBox::MacToUnix(name), e)) {
+			t.exists = true;
+			t.mtime = e.mtime;
+		}
+
+		if (!t.exists && !t.single_f && !t.double_f && t.commands.empty())
+			throw mpw_error(1, "Make - Don't know how to make \"" + name + "\".");
+
+		for (const auto &d : t.deps) make(d);
+		for (const auto &r : t.rules)
+			for (const auto &d : r.deps) make(d);
+
+		auto out_of_date = [&](const std::vector<std::string> &deps, std::vector<std::string> &v){
+			v = newer(t, deps);
+			return everything || !t.exists || !v.empty();
+		};
+
+		std::vector<std::string> v;
+		if (t.double_f) {
+			for (const auto &r : t.rules) {
+				if (!out_of_date(r.deps, v)) continue;
+				t.rebuilt = true;
+				emit(name, t, r, v);
+			}
+		}
+		else if (out_of_date(t.deps, v)) {
+			// a target without commands is out of date if anything it depends on is.
+			t.rebuilt = true;
+			if (!t.commands.empty()) emit(name, t, rule{t.deps, t.commands}, v);
+		}
+
+		if (progress && (t.single_f || t.double_f || !t.commands.empty())) {
+			if (t.rebuilt) fprintf(stderr, "# Make - \"%s\" is out of date\n", name.c_str());
+			else if (!quiet_current) fprintf(stderr, "# Make - \"%s\" is up to date\n", name.c_str());
+		}
+
+		t.state = target::done;
+	}
+
+}
+
+
+bool native_make_supported(const std::vector<std::string> &argv) {
+	for (const auto &s : argv) {
+		if (s == "-r" || s == "-s" || s == "-t" || s == "-u") return false;
+	}
+	return true;
+}
+
+
+int native_make(const Environment &env, const std::vector<std::string> &argv, std::string &out, native_make_state *state) {
+
+	stat_cache local;
+	makefile mf(env, state ? state->cache : local);
+
+	// even after an error, so a fixed makefile is noticed.
+	auto record = [&](){
+		if (!state) return;
+		state->files = mf.makefiles;
+		auto v = mf.targets();
+		state->files.insert(state->files.end(), v.begin(), v.end());
+	};
+	std::vector<std::string> files;
+	std::vector<std::string> targets;
+
+	try {
+		for (size_t i = 0; i < argv.size(); ++i) {
+			const std::string &s = argv[i];
+			if (s == "-d" || s == "-f" || s == "-i") {
+				if (++i == argv.size()) throw mpw_error(1, "Make - Missing value for " + s + ".");
+				const std::string &value = argv[i];
+				if (s == "-f") files.push_back(value);
+				if (s == "-i") mf.include_dirs.push_back(value);
+				if (s == "-d") {
+					size_t pos = value.find('=');
+					if (pos == std::string::npos) mf.define(value, "", true);
+					else mf.define(value.substr(0, pos), value.substr(pos + 1), true);
+				}
+				continue;
+			}
+			if (s == "-e") { mf.everything = true; continue; }
+			if (s == "-p") { mf.progress = true; continue; }
+			if (s == "-v") { mf.progress = mf.verbose = true; continue; }
+			if (s == "-y") { mf.progress = mf.verbose = mf.quiet_current = true; continue; }
+			if (s == "-w") { mf.warnings = false; continue; }
+			if (s.size() > 1 && s[0] == '-')
+				throw mpw_error(1, "Make - " + s + " is not an option.");
+			targets.push_back(s);
+		}
+
+		if (files.empty()) {
+			std::string name = "MakeFile";
+			for (const char *cp : { "MakeFile", "Makefile", "makefile" }) {
+				struct stat st;
+				if (::stat(cp, &st) == 0) { name = cp; break; }
+			}
+			files.push_back(name);
+		}
+
+		for (const auto &f : files) mf.read(f);
+
+		// {MakeStatCache} is 1 (next to the makefile) or a file name.
+		// (a warm cache is only loaded once.)
+		std::string cache = env.get("makestatcache");
+		if (state && state->opened) cache.clear();
+		if (state) state->opened = true;
+		if (!cache.empty() && cache != "0") {
+			if (cache == "1") {
+				std::string path = ToolBox::MacToUnix(files.front());
+				size_t pos = path.rfind('/');
+				if (pos == std::string::npos) cache = "." + path + ".stat";
+				else cache = path.substr(0, pos + 1) + "." + path.substr(pos + 1) + ".stat";
+			}
+			else cache = ToolBox::MacToUnix(cache);
+			mf.cache.open(cache);
+		}
+
+		if (targets.empty()) {
+			if (mf.first_target().empty()) throw mpw_error(1, "Make - No targets were specified.");
+			targets.push_back(mf.first_target());
+		}
+
+		for (const auto &t : targets) mf.make(t);
+
+		if (mf.verbose) {
+			fprintf(stderr, "# Make - %zu files, %llu cached, %llu stat-ed, %llu changed since the last run\n",
+				mf.cache.size(),
+				(unsigned long long)mf.cache.hits(),
+				(unsigned long long)mf.cache.stats(),
+				(unsigned long long)mf.cache.changed());
+		}
+		// the script is about to rewrite these, maybe in place.
+		for (const auto &t : mf.rebuilt()) mf.cache.invalidate(t);
+		mf.cache.save();
+	}
+	catch (const mpw_error &ex) {
+		fprintf(stderr, "### %s\n", ex.what());
+		record();
+		return ex.status();
+	}
+
+	record();
+	out = mf.script();
+	return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef __native_make_h__
+#define __native_make_h__
+
+#include <string>
+#include <vector>
+
+#include "stat_cache.h"
+
+class Environment;
+
+/*
+ * MPW Make without the emulator.  reads the makefile(s), checks dates and
+ * generates the same build script the Make tool would.
+ *
+ * argv is Make's argument list (without argv[0]).  -d, -e, -f, -i, -p, -v,
+ * -w and -y are handled.  -r, -s, -t and -u are not -- use the real Make
+ * when native_make_supported() returns false.
+ *
+ * returns 0 and the script in out, or prints a ### diagnostic and returns
+ * non-zero.
+ */
+
+/*
+ * state kept between runs (mpw-make --watch).  the stat cache stays in
+ * memory, so only files that were invalidated are stat-ed again.  files is
+ * set to the makefiles and every target and prerequisite (unix paths, as
+ * used by the cache).
+ */
+struct native_make_state {
+	stat_cache cache;
+	std::vector<std::string> files;
+	bool opened = false;
+};
+
+bool native_make_supported(const std::vector<std::string> &argv);
+int native_make(const Environment &env, const std::vector<std::string> &argv, std::string &out, native_make_state *state = nullptr);
+
+#endif
@@ -0,0 +1,230 @@
+#include "parallel.h"
+#include "environment.h"
+#include "error.h"
+#include "phase3.h"
+#include "echo_buffer.h"
+#include "profile.h"
+#include "resource_usage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sysexits.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace {
+
+	int temp_file() {
+		char temp[32] = "/tmp/mpw-shell-XXXXXXXX";
+		int fd = mkstemp(temp);
+		if (fd < 0) {
+			perror("mkstemp: ");
+			exit(EX_OSERR);
+		}
+		unlink(temp);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		return fd;
+	}
+
+	void copy_file(int from, int to) {
+		char buffer[4096];
+		lseek(from, 0, SEEK_SET);
+		for(;;) {
+			ssize_t size = read(from, buffer, sizeof(buffer));
+			if (size < 0 && errno == EINTR) continue;
+			if (size <= 0) return;
+			const char *cp = buffer;
+			while (size) {
+				ssize_t rv = write(to, cp, size);
+				if (rv < 0) {
+					if (errno == EINTR) continue;
+					return;
+				}
+				cp += rv;
+				size -= rv;
+			}
+		}
+	}
+
+	void close_fd(int &fd) {
+		if (fd >= 0) close(fd);
+		fd = -1;
+	}
+
+}
+
+
+unsigned parallel_runner::default_jobs(const Environment &env) {
+	long n = strtol(env.get("paralleljobs").c_str(), nullptr, 10);
+	if (n > 0) return n;
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+}
+
+
+parallel_runner::parallel_runner(Environment &env, const fdmask &fds, unsigned jobs, result_function fx) :
+	_env(env), _fds(fds), _limit(std::max(jobs, 1u)), _fx(std::move(fx))
+{}
+
+parallel_runner::~parallel_runner() {
+	// only if an exception escaped before finish().
+	if (_running) {
+		_stopped = true;
+		kill_after(0, SIGTERM);
+		finish();
+	}
+}
+
+
+bool parallel_runner::run(job_function fx) {
+
+	while (!_stopped && _running >= _limit) {
+		reap();
+		replay();
+	}
+	if (_stopped) return false;
+
+	job j;
+	int result_pipe[2];
+
+	j.out = temp_file();
+	j.err = temp_file();
+	if (pipe(result_pipe) < 0) {
+		perror("pipe: ");
+		exit(EX_OSERR);
+	}
+	fcntl(result_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(result_pipe[1], F_SETFD, FD_CLOEXEC);
+	fcntl(result_pipe[0], F_SETFL, O_NONBLOCK);
+
+	echo_flush();
+	fflush(stdout);
+	fflush(stderr);
+	j.begin = profile_now();
+	j.pid = fork();
+	if (j.pid < 0) {
+		perror("fork: ");
+		exit(EX_OSERR);
+	}
+
+	if (j.pid == 0) {
+		// child -- everything written to stdout / stderr is buffered.
+		_monitor.child_reset();
+		close(result_pipe[0]);
+		dup2(j.out, STDOUT_FILENO);
+		dup2(j.err, STDERR_FILENO);
+
+		result r;
+		try {
+			r.status = fx(fdmask(_fds[0], STDOUT_FILENO, STDERR_FILENO));
+		}
+		catch (const break_command_t &) { r.flow = BREAK; }
+		catch (const continue_command_t &) { r.flow = CONTINUE; }
+		catch (const exit_command_t &ex) { r.flow = EXIT; r.status = ex.value; }
+		catch (const mpw_error &ex) { r.status = ex.status(); }
+		catch (const std::exception &ex) {
+			fprintf(stderr, "### %s\n", ex.what());
+			r.status = -4;
+		}
+
+		echo_flush();
+		fflush(stdout);
+		fflush(stderr);
+		while (write(result_pipe[1], &r, sizeof(r)) < 0 && errno == EINTR) ;
+		// skip atexit handlers -- they belong to the parent.
+		_exit(0);
+	}
+
+	_monitor.add(j.pid);
+	close(result_pipe[1]);
+	j.result_fd = result_pipe[0];
+	_jobs.emplace_back(std::move(j));
+	++_running;
+	return true;
+}
+
+
+void parallel_runner::finish() {
+	while (_running) {
+		reap();
+		replay();
+	}
+	replay();
+
+	// ^C while waiting -- the jobs got it too.
+	if (_monitor.interrupted()) _env.control_c()++;
+}
+
+
+void parallel_runner::reap() {
+
+	child_monitor::event ev;
+	while (_monitor.wait(ev)) {
+
+		auto iter = std::find_if(_jobs.begin(), _jobs.end(), [&ev](const job &j){
+			return j.pid == ev.pid && !j.done;
+		});
+		if (iter == _jobs.end()) continue;
+
+		job &j = *iter;
+		j.done = true;
+		--_running;
+
+		_env.add_usage(resource_usage(ev.ru, ev.wall_time));
+		profile_event("parallel", "job", j.begin, profile_now());
+
+		// killed before it could report.
+		if (read(j.result_fd, &j.r, sizeof(j.r)) != sizeof(j.r)) {
+			j.r = result();
+			j.r.status = WIFEXITED(ev.status) ? WEXITSTATUS(ev.status) : -9;
+		}
+		close_fd(j.result_fd);
+		return;
+	}
+
+	// shouldn't happen...
+	for (auto &j : _jobs) {
+		if (j.done) continue;
+		j.done = true;
+		j.r.status = -9;
+		close_fd(j.result_fd);
+	}
+	_running = 0;
+}
+
+
+void parallel_runner::replay() {
+
+	while (_next < _jobs.size() && _jobs[_next].done) {
+		job &j = _jobs[_next];
+
+		if (!_stopped) {
+			copy_file(j.out, _fds[1]);
+			copy_file(j.err, _fds[2]);
+			if (!_fx(j.r)) {
+				_stopped = true;
+				kill_after(_next + 1, SIGTERM);
+			}
+		}
+		close_fd(j.out);
+		close_fd(j.err);
+		++_next;
+	}
+}
+
+
+void parallel_runner::kill_after(size_t index, int signal) {
+	for (size_t i = index; i < _jobs.size(); ++i) {
+		if (!_jobs[i].done) kill(_jobs[i].pid, signal);
+	}
+}
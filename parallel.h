@@ -0,0 +1,80 @@
+#ifndef __parallel_h__
+#define __parallel_h__
+
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "fdset.h"
+#include "child_monitor.h"
+
+class Environment;
+
+/*
+ * runs jobs in forked copies of the shell, at most jobs at a time.
+ * each job's stdout and stderr (including {Echo} output) go to temporary
+ * files which are replayed in the order the jobs were started.
+ *
+ * after a job's output is replayed, the result function is called.  if it
+ * returns false, later jobs are killed, their output is discarded and no
+ * new jobs are started.
+ */
+class parallel_runner {
+
+public:
+
+	struct result {
+		int status = 0;
+		int flow = 0; // 0, BREAK, CONTINUE, or EXIT
+	};
+
+	typedef std::function<bool(const result &)> result_function;
+	typedef std::function<int(const fdmask &)> job_function;
+
+	parallel_runner(Environment &env, const fdmask &fds, unsigned jobs, result_function fx);
+	~parallel_runner();
+
+	parallel_runner(const parallel_runner &) = delete;
+	parallel_runner &operator=(const parallel_runner &) = delete;
+
+	// blocks while jobs are running at the limit.  returns false once stopped.
+	bool run(job_function fx);
+
+	// wait for everything to finish.
+	void finish();
+
+	bool stopped() const noexcept { return _stopped; }
+
+	// {ParallelJobs} or the number of cpus.
+	static unsigned default_jobs(const Environment &env);
+
+private:
+
+	struct job {
+		pid_t pid = -1;
+		int out = -1;
+		int err = -1;
+		int result_fd = -1;
+		bool done = false;
+		result r;
+		uint64_t begin = 0;
+	};
+
+	void reap();
+	void replay();
+	void kill_after(size_t index, int signal);
+
+	Environment &_env;
+	fdmask _fds;
+	unsigned _limit;
+	unsigned _running = 0;
+	bool _stopped = false;
+	size_t _next = 0;
+	result_function _fx;
+	std::vector<job> _jobs;
+	child_monitor _monitor;
+};
+
+#endif
@@ -26,6 +26,9 @@
 
 
 #include <string>
+#include <functional>
+#include <cstdint>
+#include <atomic>
 
 //#include "toolbox.h"
 
@@ -136,6 +139,44 @@ namespace {
 		write data;
 	}%%
 
+
+	// counted for every thread (Parallel, For -p), not just the caller.
+	std::atomic<uint64_t> cache_hits{0};
+	std::atomic<uint64_t> cache_misses{0};
+
+	/*
+	 * the same few hundred paths ({Commands} entries, redirection targets,
+	 * arguments to Exists/Directory/Catenate) are translated over and over.
+	 * this is a direct-mapped cache -- a miss just replaces the slot.
+	 */
+	struct path_cache {
+		static constexpr unsigned size = 512;
+
+		struct entry {
+			std::string key;
+			std::string value;
+		};
+
+		entry entries[size];
+
+		template<class FX>
+		const std::string &lookup(const std::string &key, FX fx) {
+			entry &e = entries[std::hash<std::string>()(key) & (size - 1)];
+			if (e.key == key && !key.empty()) {
+				cache_hits.fetch_add(1, std::memory_order_relaxed);
+				return e.value;
+			}
+			cache_misses.fetch_add(1, std::memory_order_relaxed);
+			e.value = fx(key);
+			e.key = key;
+			return e.value;
+		}
+	};
+
+	// per thread so no locking is needed.
+	thread_local path_cache mac_cache;
+	thread_local path_cache unix_cache;
+
 }
 
 namespace ToolBox
@@ -159,7 +200,7 @@ namespace ToolBox
 
 	}
 
-	std::string MacToUnix(const std::string path)
+	static std::string mac_to_unix(const std::string &path)
 	{
 
 		// todo -- Dev:Null -> lowercase it?
@@ -214,7 +255,7 @@ namespace ToolBox
 	}
 
 
-	std::string UnixToMac(const std::string path)
+	static std::string unix_to_mac(const std::string &path)
 	{
 		// /volume/directory -> volume:directory
 		// // -> /
@@ -272,6 +313,25 @@ namespace ToolBox
 	}
 
 
+	std::string MacToUnix(const std::string path)
+	{
+		// no colon - no problem.
+		if (path.find(':') == path.npos) return path;
+		return mac_cache.lookup(path, mac_to_unix);
+	}
+
+	std::string UnixToMac(const std::string path)
+	{
+		if (path.find('/') == path.npos) return path;
+		return unix_cache.lookup(path, unix_to_mac);
+	}
+
+	void PathCacheStats(uint64_t &hits, uint64_t &misses)
+	{
+		hits = cache_hits.load(std::memory_order_relaxed);
+		misses = cache_misses.load(std::memory_order_relaxed);
+	}
+
 }
 
 
@@ -212,6 +212,7 @@ int phase2::classify() {
 	_("for", FOR)
 	_("if", IF)
 	_("loop", LOOP)
+	_("parallel", BEGIN)
 
 #undef _
 	return type;
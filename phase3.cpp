@@ -137,8 +137,9 @@ namespace {
 
 #include "phase3_parser.h"
 #include "command.h"
+#include "echo_buffer.h"
 #define LEMON_SUPER phase3
-#line 142 "phase3.cpp"
+#line 143 "phase3.cpp"
 /**************** End of %include directives **********************************/
 /* These constants specify the various numeric values for terminal symbols
 ** in a format understandable to "makeheaders".  This section is blank unless
@@ -1116,11 +1117,11 @@ void yypParser::yy_reduce(
   yy_destructor<void>(std::addressof(yymsp[-2].minor.yy7));
   yy_destructor<command_ptr>(std::addressof(yymsp[0].minor.yy17));
   auto &C=yy_cast< command_ptr >(std::addressof(yymsp[-1].minor.yy17));
-#line 95 "phase3.lemon"
+#line 97 "phase3.lemon"
 {
 	if (C) command_queue.emplace_back(std::move(C));
 }
-#line 1124 "phase3.cpp"
+#line 1125 "phase3.cpp"
   yy_destructor(C);
   yy_constructor<void>(std::addressof(yymsp[-2].minor.yy7));
 }
@@ -1130,11 +1131,11 @@ void yypParser::yy_reduce(
   yy_destructor<command_ptr>(std::addressof(yymsp[0].minor.yy17));
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[-2].minor.yy35));
   auto &C=yy_cast< command_ptr >(std::addressof(yymsp[-1].minor.yy17));
-#line 111 "phase3.lemon"
+#line 113 "phase3.lemon"
 {
 	if (C) L.emplace_back(std::move(C));
 }
-#line 1138 "phase3.cpp"
+#line 1139 "phase3.cpp"
   yy_destructor(C);
 }
         break;
@@ -1145,11 +1146,11 @@ void yypParser::yy_reduce(
    command_ptr  RV;
   auto &L=yy_cast< command_ptr >(std::addressof(yymsp[-3].minor.yy17));
   auto &R=yy_cast< command_ptr >(std::addressof(yymsp[0].minor.yy17));
-#line 124 "phase3.lemon"
+#line 126 "phase3.lemon"
 {
 	RV = std::make_unique<or_command>(std::move(L), std::move(R));
 }
-#line 1153 "phase3.cpp"
+#line 1154 "phase3.cpp"
   yy_destructor(L);
   yy_destructor(R);
   yy_constructor< command_ptr >(std::addressof(yymsp[-3].minor.yy17), std::move(RV));
@@ -1162,11 +1163,11 @@ void yypParser::yy_reduce(
    command_ptr  RV;
   auto &L=yy_cast< command_ptr >(std::addressof(yymsp[-3].minor.yy17));
   auto &R=yy_cast< command_ptr >(std::addressof(yymsp[0].minor.yy17));
-#line 128 "phase3.lemon"
+#line 130 "phase3.lemon"
 {
 	RV = std::make_unique<and_command>(std::move(L), std::move(R));
 }
-#line 1170 "phase3.cpp"
+#line 1171 "phase3.cpp"
   yy_destructor(L);
   yy_destructor(R);
   yy_constructor< command_ptr >(std::addressof(yymsp[-3].minor.yy17), std::move(RV));
@@ -1179,11 +1180,11 @@ void yypParser::yy_reduce(
    command_ptr  RV;
   auto &L=yy_cast< command_ptr >(std::addressof(yymsp[-3].minor.yy17));
   auto &R=yy_cast< command_ptr >(std::addressof(yymsp[0].minor.yy17));
-#line 132 "phase3.lemon"
+#line 134 "phase3.lemon"
 {
 	RV = std::make_unique<pipe_command>(std::move(L), std::move(R));
 }
-#line 1187 "phase3.cpp"
+#line 1188 "phase3.cpp"
   yy_destructor(L);
   yy_destructor(R);
   yy_constructor< command_ptr >(std::addressof(yymsp[-3].minor.yy17), std::move(RV));
@@ -1193,9 +1194,9 @@ void yypParser::yy_reduce(
 {
   command_ptr RV;
   auto &C=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
-#line 138 "phase3.lemon"
+#line 140 "phase3.lemon"
 { RV = std::make_unique<simple_command>(std::move(C)); }
-#line 1199 "phase3.cpp"
+#line 1200 "phase3.cpp"
   yy_destructor(C);
   yy_constructor<command_ptr>(std::addressof(yymsp[0].minor.yy17), std::move(RV));
 }
@@ -1204,9 +1205,9 @@ void yypParser::yy_reduce(
 {
   command_ptr RV;
   auto &C=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
-#line 139 "phase3.lemon"
+#line 141 "phase3.lemon"
 { RV = std::make_unique<evaluate_command>(std::move(C)); }
-#line 1210 "phase3.cpp"
+#line 1211 "phase3.cpp"
   yy_destructor(C);
   yy_constructor<command_ptr>(std::addressof(yymsp[0].minor.yy17), std::move(RV));
 }
@@ -1215,9 +1216,9 @@ void yypParser::yy_reduce(
 {
   command_ptr RV;
   auto &C=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
-#line 140 "phase3.lemon"
+#line 142 "phase3.lemon"
 { RV = std::make_unique<break_command>(std::move(C)); }
-#line 1221 "phase3.cpp"
+#line 1222 "phase3.cpp"
   yy_destructor(C);
   yy_constructor<command_ptr>(std::addressof(yymsp[0].minor.yy17), std::move(RV));
 }
@@ -1226,9 +1227,9 @@ void yypParser::yy_reduce(
 {
   command_ptr RV;
   auto &C=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
-#line 141 "phase3.lemon"
+#line 143 "phase3.lemon"
 { RV = std::make_unique<continue_command>(std::move(C)); }
-#line 1232 "phase3.cpp"
+#line 1233 "phase3.cpp"
   yy_destructor(C);
   yy_constructor<command_ptr>(std::addressof(yymsp[0].minor.yy17), std::move(RV));
 }
@@ -1237,9 +1238,9 @@ void yypParser::yy_reduce(
 {
   command_ptr RV;
   auto &C=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
-#line 142 "phase3.lemon"
+#line 144 "phase3.lemon"
 { RV = std::make_unique<exit_command>(std::move(C)); }
-#line 1243 "phase3.cpp"
+#line 1244 "phase3.cpp"
   yy_destructor(C);
   yy_constructor<command_ptr>(std::addressof(yymsp[0].minor.yy17), std::move(RV));
 }
@@ -1249,11 +1250,11 @@ void yypParser::yy_reduce(
   command_ptr RV;
   auto &C=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
   const int yymsp_1_major = yymsp[0].major; /* @C */
-#line 151 "phase3.lemon"
+#line 153 "phase3.lemon"
 {
 	RV = std::make_unique<error_command>(yymsp_1_major, std::move(C));
 }
-#line 1257 "phase3.cpp"
+#line 1258 "phase3.cpp"
   yy_destructor(C);
   yy_constructor<command_ptr>(std::addressof(yymsp[0].minor.yy17), std::move(RV));
 }
@@ -1262,11 +1263,11 @@ void yypParser::yy_reduce(
 {
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[-1].minor.yy35));
   auto &C=yy_cast< command_ptr >(std::addressof(yymsp[0].minor.yy17));
-#line 180 "phase3.lemon"
+#line 182 "phase3.lemon"
 {
 	L.emplace_back(std::move(C));
 }
-#line 1270 "phase3.cpp"
+#line 1271 "phase3.cpp"
   yy_destructor(C);
 }
         break;
@@ -1277,11 +1278,11 @@ void yypParser::yy_reduce(
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[-1].minor.yy35));
   auto &E=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
   const int yymsp_1_major = yymsp[-2].major; /* @T */
-#line 184 "phase3.lemon"
+#line 186 "phase3.lemon"
 {
 	RV = std::make_unique<begin_command>(yymsp_1_major, std::move(L), std::move(T), std::move(E));
 }
-#line 1285 "phase3.cpp"
+#line 1286 "phase3.cpp"
   yy_destructor(T);
   yy_destructor(L);
   yy_destructor(E);
@@ -1296,11 +1297,14 @@ void yypParser::yy_reduce(
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[-1].minor.yy35));
   auto &E=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
   const int yymsp_1_major = yymsp[-3].major; /* @T */
-#line 189 "phase3.lemon"
+#line 192 "phase3.lemon"
 {
-	RV = std::make_unique<begin_command>(yymsp_1_major, std::move(L), std::move(T), std::move(E));
+	if (parallel_command::is_parallel(T))
+		RV = std::make_unique<parallel_command>(yymsp_1_major, std::move(L), std::move(T), std::move(E));
+	else
+		RV = std::make_unique<begin_command>(yymsp_1_major, std::move(L), std::move(T), std::move(E));
 }
-#line 1304 "phase3.cpp"
+#line 1308 "phase3.cpp"
   yy_destructor(T);
   yy_destructor(L);
   yy_destructor(E);
@@ -1315,11 +1319,11 @@ void yypParser::yy_reduce(
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[-1].minor.yy35));
   auto &E=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
   const int yymsp_1_major = yymsp[-3].major; /* @T */
-#line 194 "phase3.lemon"
+#line 200 "phase3.lemon"
 {
 	RV = std::make_unique<loop_command>(yymsp_1_major, std::move(L), std::move(T), std::move(E));
 }
-#line 1323 "phase3.cpp"
+#line 1327 "phase3.cpp"
   yy_destructor(T);
   yy_destructor(L);
   yy_destructor(E);
@@ -1334,11 +1338,11 @@ void yypParser::yy_reduce(
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[-1].minor.yy35));
   auto &E=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
   const int yymsp_1_major = yymsp[-3].major; /* @T */
-#line 198 "phase3.lemon"
+#line 204 "phase3.lemon"
 {
 	RV = std::make_unique<for_command>(yymsp_1_major, std::move(L), std::move(T), std::move(E));
 }
-#line 1342 "phase3.cpp"
+#line 1346 "phase3.cpp"
   yy_destructor(T);
   yy_destructor(L);
   yy_destructor(E);
@@ -1352,7 +1356,7 @@ void yypParser::yy_reduce(
   auto &I=yy_cast<std::string>(std::addressof(yymsp[-3].minor.yy0));
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[-1].minor.yy35));
   auto &E=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
-#line 202 "phase3.lemon"
+#line 208 "phase3.lemon"
 {
 
 	if_command::clause_vector_type v;
@@ -1364,7 +1368,7 @@ void yypParser::yy_reduce(
 	);
 
 }
-#line 1368 "phase3.cpp"
+#line 1372 "phase3.cpp"
   yy_destructor(I);
   yy_destructor(L);
   yy_destructor(E);
@@ -1379,7 +1383,7 @@ void yypParser::yy_reduce(
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[-2].minor.yy35));
   auto &EC=yy_cast< if_command::clause_vector_type >(std::addressof(yymsp[-1].minor.yy62));
   auto &E=yy_cast<std::string>(std::addressof(yymsp[0].minor.yy0));
-#line 214 "phase3.lemon"
+#line 220 "phase3.lemon"
 {
 
 	if_command::clause_vector_type v;
@@ -1389,7 +1393,7 @@ void yypParser::yy_reduce(
 	RV = std::make_unique<if_command>(
 		std::move(v), std::move(E));	
 }
-#line 1393 "phase3.cpp"
+#line 1397 "phase3.cpp"
   yy_destructor(I);
   yy_destructor(L);
   yy_destructor(EC);
@@ -1404,11 +1408,11 @@ void yypParser::yy_reduce(
   auto &E=yy_cast<std::string>(std::addressof(yymsp[-2].minor.yy0));
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[0].minor.yy35));
   const int yymsp_1_major = yymsp[-2].major; /* @E */
-#line 227 "phase3.lemon"
+#line 233 "phase3.lemon"
 {
 	RV.emplace_back(std::make_unique<if_else_clause>(yymsp_1_major, std::move(L), std::move(E)));
 }
-#line 1412 "phase3.cpp"
+#line 1416 "phase3.cpp"
   yy_destructor(E);
   yy_destructor(L);
   yy_constructor< if_command::clause_vector_type >(std::addressof(yymsp[-2].minor.yy62), std::move(RV));
@@ -1421,11 +1425,11 @@ void yypParser::yy_reduce(
   auto &E=yy_cast<std::string>(std::addressof(yymsp[-2].minor.yy0));
   auto &L=yy_cast< command_ptr_vector >(std::addressof(yymsp[0].minor.yy35));
   const int yymsp_2_major = yymsp[-2].major; /* @E */
-#line 232 "phase3.lemon"
+#line 238 "phase3.lemon"
 {
 	EC.emplace_back(std::make_unique<if_else_clause>(yymsp_2_major, std::move(L), std::move(E)));
 }
-#line 1429 "phase3.cpp"
+#line 1433 "phase3.cpp"
   yy_destructor(E);
   yy_destructor(L);
 }
@@ -1797,7 +1801,7 @@ bool yypParser::will_accept() const {
 
 
 } // namespace
-#line 15 "phase3.lemon"
+#line 16 "phase3.lemon"
 
 	
 std::unique_ptr<phase3> phase3::make() {
@@ -1854,9 +1858,10 @@ void phase3::syntax_error(int yymajor, std::string &yyminor) {
 */
 
 	
+	echo_flush();
 	fprintf(stderr, "### MPW Shell - Parse error near %s\n", yymajor ? yyminor.c_str() : "EOF");
 	error = true;
 }
 
 
-#line 1863 "phase3.cpp"
+#line 1868 "phase3.cpp"
@@ -0,0 +1,196 @@
+#include "profile.h"
+#include "macroman.h"
+#include "echo_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+std::atomic<bool> profiling{false};
+
+namespace ToolBox {
+	void PathCacheStats(uint64_t &hits, uint64_t &misses);
+}
+
+namespace {
+
+	struct event {
+		const char *category;
+		std::string name;
+		uint64_t begin;
+		uint64_t end;
+		int tid;
+		alloc_count allocs;
+	};
+
+	std::mutex mutex;
+	std::vector<event> events;
+	std::string trace_file;
+	pid_t trace_pid = 0;
+
+	const auto epoch = std::chrono::steady_clock::now();
+
+	int thread_id() {
+		static std::atomic<int> next{1};
+		static thread_local int tid = next++;
+		return tid;
+	}
+
+	std::string json_string(const std::string &s) {
+		std::string rv;
+		rv.reserve(s.size() + 2);
+		rv.push_back('"');
+		for (unsigned char c : macroman_to_utf8(s)) {
+			switch(c) {
+				case '"': rv.append("\\\""); break;
+				case '\\': rv.append("\\\\"); break;
+				case '\n': rv.append("\\n"); break;
+				case '\r': rv.append("\\r"); break;
+				case '\t': rv.append("\\t"); break;
+				default:
+					if (c < 0x20) {
+						char buffer[8];
+						snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+						rv.append(buffer);
+					}
+					else rv.push_back(c);
+			}
+		}
+		rv.push_back('"');
+		return rv;
+	}
+
+	void write_trace() {
+		FILE *fp = fopen(trace_file.c_str(), "w");
+		if (!fp) {
+			fprintf(stderr, "### MPW Shell - Unable to open \"%s\".\n", trace_file.c_str());
+			return;
+		}
+
+		fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+		bool first = true;
+		for (const auto &e : events) {
+			if (!first) fputs(",\n", fp);
+			first = false;
+			fprintf(fp, "{\"name\":%s,\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d",
+				json_string(e.name).c_str(), e.category,
+				(unsigned long long)e.begin, (unsigned long long)(e.end - e.begin),
+				(int)trace_pid, e.tid);
+			if (alloc_stats_enabled) {
+				fprintf(fp, ",\"args\":{\"allocs\":%llu,\"alloc_bytes\":%llu}",
+					(unsigned long long)e.allocs.count, (unsigned long long)e.allocs.bytes);
+			}
+			fputs("}", fp);
+		}
+		fputs("\n]}\n", fp);
+		fclose(fp);
+	}
+
+	void write_summary() {
+
+		struct total {
+			unsigned count = 0;
+			uint64_t time = 0;
+			uint64_t max = 0;
+		};
+
+		std::map<std::string, total> totals;
+		for (const auto &e : events) {
+			if (strcmp(e.category, "command")) continue;
+			auto &t = totals[e.name];
+			uint64_t d = e.end - e.begin;
+			t.count++;
+			t.time += d;
+			t.max = std::max(t.max, d);
+		}
+		if (totals.empty()) return;
+
+		std::vector<std::pair<std::string, total>> v(totals.begin(), totals.end());
+		std::sort(v.begin(), v.end(), [](const auto &a, const auto &b){
+			return a.second.time > b.second.time;
+		});
+		if (v.size() > 20) v.resize(20);
+
+		fprintf(stderr, "# Profile - top commands by wall time\n");
+		fprintf(stderr, "# %8s %12s %12s %12s  %s\n", "count", "total ms", "avg ms", "max ms", "command");
+		for (const auto &kv : v) {
+			const auto &t = kv.second;
+			fprintf(stderr, "# %8u %12.3f %12.3f %12.3f  %s\n",
+				t.count, t.time / 1000.0, t.time / 1000.0 / t.count, t.max / 1000.0,
+				kv.first.c_str());
+		}
+
+		uint64_t hits, misses;
+		ToolBox::PathCacheStats(hits, misses);
+		if (hits + misses) {
+			fprintf(stderr, "# Path cache - %llu hits, %llu misses (%.1f%%)\n",
+				(unsigned long long)hits, (unsigned long long)misses,
+				hits * 100.0 / (hits + misses));
+		}
+
+		if (alloc_stats_enabled) fputs(alloc_stats_summary().c_str(), stderr);
+	}
+}
+
+
+uint64_t profile_now() {
+	auto d = std::chrono::steady_clock::now() - epoch;
+	return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+void profile_event(const char *category, const std::string &name, uint64_t begin, uint64_t end, const alloc_count &allocs) {
+	if (!profiling) return;
+	std::lock_guard<std::mutex> lock(mutex);
+	events.emplace_back(event{category, name, begin, end, thread_id(), allocs});
+}
+
+void profile_start(const std::string &file) {
+	if (profiling || file.empty()) return;
+
+	trace_file = file;
+	trace_pid = getpid();
+	profiling = true;
+	atexit(profile_finish);
+}
+
+void profile_finish() {
+	if (!profiling) return;
+
+	// forked children don't own the trace.
+	if (trace_pid != getpid()) return;
+	profiling = false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::stable_sort(events.begin(), events.end(), [](const event &a, const event &b){
+		return a.begin < b.begin;
+	});
+
+	echo_flush();
+	write_trace();
+	write_summary();
+	events.clear();
+}
+
+
+void profile_span::start(const char *category, const std::string &name) {
+	_category = category;
+	_name = name;
+	_begin = profile_now();
+	_allocs = alloc_thread_total();
+}
+
+void profile_span::finish() {
+	alloc_count end = alloc_thread_total();
+	end.count -= _allocs.count;
+	end.bytes -= _allocs.bytes;
+	profile_event(_category, _name, _begin, profile_now(), end);
+}
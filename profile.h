@@ -0,0 +1,59 @@
+#ifndef __profile_h__
+#define __profile_h__
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+#include "alloc_stats.h"
+
+/*
+ * -P file (or {Profile}) records timed spans.  At exit, they're written
+ * as chrome trace-event json (chrome://tracing, ui.perfetto.dev) and a
+ * summary of the slowest commands is printed to stderr.
+ *
+ * built with MPW_SHELL_ALLOC_STATS, spans also record the allocations made
+ * by their thread (including nested spans).
+ */
+
+// set by profile_start; read by the echo writer and library threads.
+extern std::atomic<bool> profiling;
+
+void profile_start(const std::string &file);
+void profile_finish();
+
+uint64_t profile_now();
+void profile_event(const char *category, const std::string &name, uint64_t begin, uint64_t end,
+	const alloc_count &allocs = alloc_count());
+
+
+class profile_span {
+public:
+
+	profile_span(const char *category, const char *name) : _active(profiling) {
+		if (_active) start(category, name);
+	}
+
+	profile_span(const char *category, const std::string &name) : _active(profiling) {
+		if (_active) start(category, name);
+	}
+
+	profile_span(const profile_span &) = delete;
+	profile_span &operator=(const profile_span &) = delete;
+
+	~profile_span() {
+		if (_active) finish();
+	}
+
+private:
+	void start(const char *category, const std::string &name);
+	void finish();
+
+	bool _active;
+	const char *_category = nullptr;
+	std::string _name;
+	uint64_t _begin = 0;
+	alloc_count _allocs;
+};
+
+#endif
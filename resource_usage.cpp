@@ -0,0 +1,123 @@
+#include "resource_usage.h"
+
+#include <algorithm>
+
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+namespace {
+
+	int64_t usec(const struct timeval &tv) {
+		return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+	}
+
+	bool ends_with(const std::string &s, const char *suffix) {
+		std::string x(suffix);
+		if (s.size() < x.size()) return false;
+		return std::equal(x.rbegin(), x.rend(), s.rbegin(), [](char a, char b){
+			return a == std::tolower(b);
+		});
+	}
+
+	std::string csv_string(const std::string &s) {
+		if (s.find_first_of(",\"\n") == s.npos) return s;
+		std::string rv = "\"";
+		for (char c : s) {
+			if (c == '"') rv.push_back('"');
+			rv.push_back(c);
+		}
+		rv.push_back('"');
+		return rv;
+	}
+
+	std::string json_string(const std::string &s) {
+		std::string rv = "\"";
+		for (unsigned char c : s) {
+			if (c == '"' || c == '\\') rv.push_back('\\');
+			if (c < 0x20) {
+				char buffer[8];
+				snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+				rv.append(buffer);
+				continue;
+			}
+			rv.push_back(c);
+		}
+		rv.push_back('"');
+		return rv;
+	}
+
+}
+
+resource_usage::resource_usage(const struct rusage &ru, int64_t wall) {
+	wall_time = wall;
+	user_time = usec(ru.ru_utime);
+	system_time = usec(ru.ru_stime);
+#if defined(__APPLE__)
+	max_rss = ru.ru_maxrss / 1024; // bytes
+#else
+	max_rss = ru.ru_maxrss;
+#endif
+	minor_faults = ru.ru_minflt;
+	major_faults = ru.ru_majflt;
+	voluntary_switches = ru.ru_nvcsw;
+	involuntary_switches = ru.ru_nivcsw;
+	commands = 1;
+}
+
+resource_usage &resource_usage::operator+=(const resource_usage &rhs) {
+	wall_time += rhs.wall_time;
+	user_time += rhs.user_time;
+	system_time += rhs.system_time;
+	max_rss = std::max(max_rss, rhs.max_rss);
+	minor_faults += rhs.minor_faults;
+	major_faults += rhs.major_faults;
+	voluntary_switches += rhs.voluntary_switches;
+	involuntary_switches += rhs.involuntary_switches;
+	commands += rhs.commands;
+	return *this;
+}
+
+
+void log_resource_usage(const std::string &file, const std::vector<std::string> &argv, int status, const resource_usage &ru) {
+
+	bool json = ends_with(file, ".json") || ends_with(file, ".jsonl");
+
+	struct stat st;
+	bool header = !json && (stat(file.c_str(), &st) < 0 || st.st_size == 0);
+
+	FILE *fp = fopen(file.c_str(), "a");
+	if (!fp) return;
+
+	std::string command;
+	for (const auto &s : argv) {
+		if (!command.empty()) command.push_back(' ');
+		command += s;
+	}
+
+	if (header) {
+		fputs("time,command,status,wall_ms,user_ms,system_ms,max_rss_kb,"
+			"minor_faults,major_faults,voluntary_switches,involuntary_switches\n", fp);
+	}
+
+	if (json) {
+		fprintf(fp, "{\"time\":%lld,\"command\":%s,\"status\":%d,\"wall_ms\":%.3f,"
+			"\"user_ms\":%.3f,\"system_ms\":%.3f,\"max_rss_kb\":%lld,"
+			"\"minor_faults\":%lld,\"major_faults\":%lld,"
+			"\"voluntary_switches\":%lld,\"involuntary_switches\":%lld}\n",
+			(long long)time(nullptr), json_string(command).c_str(), status,
+			ru.wall_time / 1000.0, ru.user_time / 1000.0, ru.system_time / 1000.0,
+			(long long)ru.max_rss, (long long)ru.minor_faults, (long long)ru.major_faults,
+			(long long)ru.voluntary_switches, (long long)ru.involuntary_switches);
+	} else {
+		fprintf(fp, "%lld,%s,%d,%.3f,%.3f,%.3f,%lld,%lld,%lld,%lld,%lld\n",
+			(long long)time(nullptr), csv_string(command).c_str(), status,
+			ru.wall_time / 1000.0, ru.user_time / 1000.0, ru.system_time / 1000.0,
+			(long long)ru.max_rss, (long long)ru.minor_faults, (long long)ru.major_faults,
+			(long long)ru.voluntary_switches, (long long)ru.involuntary_switches);
+	}
+	fclose(fp);
+}
@@ -0,0 +1,35 @@
+#ifndef __resource_usage_h__
+#define __resource_usage_h__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct rusage;
+
+// times are in microseconds, max_rss is in kilobytes.
+struct resource_usage {
+
+	int64_t wall_time = 0;
+	int64_t user_time = 0;
+	int64_t system_time = 0;
+	int64_t max_rss = 0;
+	int64_t minor_faults = 0;
+	int64_t major_faults = 0;
+	int64_t voluntary_switches = 0;
+	int64_t involuntary_switches = 0;
+	int64_t commands = 0;
+
+	resource_usage() = default;
+	resource_usage(const struct rusage &ru, int64_t wall);
+
+	resource_usage &operator+=(const resource_usage &rhs);
+};
+
+/*
+ * append a line to the {ResourceLog} file.
+ * .json or .jsonl files are written as json lines, anything else is csv.
+ */
+void log_resource_usage(const std::string &file, const std::vector<std::string> &argv, int status, const resource_usage &ru);
+
+#endif
@@ -0,0 +1,288 @@
+#include "shell_server.h"
+#include "environment.h"
+#include "mpw-shell.h"
+#include "error.h"
+#include "echo_buffer.h"
+
+#include <thread>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace {
+
+	const char magic[] = "MPW1";
+	const uint32_t max_request = 16 << 20;
+
+	bool make_address(const std::string &path, struct sockaddr_un &addr) {
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) {
+			fprintf(stderr, "### MPW Shell - Socket path %s is too long.\n", path.c_str());
+			return false;
+		}
+		memcpy(addr.sun_path, path.c_str(), path.size());
+		return true;
+	}
+
+	bool write_all(int fd, const char *data, size_t size) {
+		while (size) {
+			ssize_t n = write(fd, data, size);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			data += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool read_all(int fd, char *data, size_t size) {
+		while (size) {
+			ssize_t n = read(fd, data, size);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			data += n;
+			size -= n;
+		}
+		return true;
+	}
+
+
+	/*
+	 * length (uint32), then NUL-terminated fields:
+	 * MPW1, directory, c or i, command, define...
+	 * stdin, stdout and stderr ride along with the first byte.
+	 */
+	bool send_request(int s, const shell_request &rq) {
+
+		std::string data;
+		data.append(magic, sizeof(magic));
+		data.append(rq.directory.c_str(), rq.directory.size() + 1);
+		data.append(rq.use_stdin ? "i" : "c", 2);
+		data.append(rq.command.c_str(), rq.command.size() + 1);
+		for (const auto &d : rq.defines) data.append(d.c_str(), d.size() + 1);
+
+		uint32_t size = data.size();
+		data.insert(0, (const char *)&size, sizeof(size));
+
+		int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+		char control[CMSG_SPACE(sizeof(fds))];
+		memset(control, 0, sizeof(control));
+
+		struct iovec iov = { (void *)data.data(), 1 };
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+		for(;;) {
+			ssize_t n = sendmsg(s, &msg, 0);
+			if (n < 0 && errno == EINTR) continue;
+			if (n != 1) return false;
+			break;
+		}
+		return write_all(s, data.data() + 1, data.size() - 1);
+	}
+
+
+	bool receive_request(int s, shell_request &rq, int fds[3]) {
+
+		char first;
+		char control[CMSG_SPACE(sizeof(int) * 3)];
+		struct iovec iov = { &first, 1 };
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ssize_t n;
+		do { n = recvmsg(s, &msg, 0); } while (n < 0 && errno == EINTR);
+		if (n != 1) return false;
+
+		bool ok = false;
+		for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+			if (cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) continue;
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 3);
+			ok = true;
+		}
+		if (!ok) return false;
+
+		uint32_t size;
+		char *cp = (char *)&size;
+		cp[0] = first;
+		if (!read_all(s, cp + 1, sizeof(size) - 1)) return false;
+		if (size > max_request) return false;
+
+		std::string data(size, 0);
+		if (!read_all(s, &data[0], size)) return false;
+
+		std::vector<std::string> fields;
+		for (size_t begin = 0; begin < data.size(); ) {
+			size_t end = data.find('\0', begin);
+			if (end == std::string::npos) return false;
+			fields.emplace_back(data, begin, end - begin);
+			begin = end + 1;
+		}
+		if (fields.size() < 4 || fields[0] != magic) return false;
+
+		rq.directory = fields[1];
+		rq.use_stdin = fields[2] == "i";
+		rq.command = fields[3];
+		rq.defines.assign(fields.begin() + 4, fields.end());
+		return true;
+	}
+
+
+	// in the forked child.  returns the exit status of the child process.
+	int run_request(const Environment &env, int s) {
+
+		shell_request rq;
+		int fds[3];
+		if (!receive_request(s, rq, fds)) return 1;
+
+		for (int i = 0; i < 3; ++i) {
+			dup2(fds[i], i);
+			if (fds[i] > 2) close(fds[i]);
+		}
+
+		// a process group so an interrupt reaches the tools, too.
+		setpgid(0, 0);
+
+		// the client went away (control-C).  it never writes after the request,
+		// so readable means closed.
+		std::thread([s](){
+			struct pollfd pfd = { s, POLLIN, 0 };
+			while (poll(&pfd, 1, -1) < 0 && errno == EINTR) ;
+			kill(-getpid(), SIGINT);
+		}).detach();
+
+		Environment e(env);
+		int32_t status = 0;
+		if (chdir(rq.directory.c_str()) < 0) {
+			fprintf(stderr, "### MPW Shell - Unable to set directory to %s: %s\n", rq.directory.c_str(), strerror(errno));
+			status = -1;
+		}
+		else {
+			for (const auto &d : rq.defines) define(e, d);
+			try {
+				status = rq.use_stdin ? read_fd(e, STDIN_FILENO) : read_string(e, rq.command);
+			} catch (const quit_command_t &) {
+				status = 0;
+			} catch (const exit_command_t &ex) {
+				status = ex.value;
+			}
+		}
+
+		echo_flush();
+		fflush(stdout);
+		fflush(stderr);
+		write_all(s, (const char *)&status, sizeof(status));
+		return 0;
+	}
+
+}
+
+
+int shell_serve(const Environment &env, const std::string &path) {
+
+	struct sockaddr_un addr;
+	if (!make_address(path, addr)) return 1;
+
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0) {
+		perror("socket");
+		return 1;
+	}
+	fcntl(s, F_SETFD, FD_CLOEXEC);
+
+	// only this user may connect.
+	mode_t mask = umask(077);
+	unlink(path.c_str());
+	int ok = bind(s, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (ok < 0 || listen(s, 64) < 0) {
+		fprintf(stderr, "### MPW Shell - Unable to listen on %s: %s\n", path.c_str(), strerror(errno));
+		close(s);
+		return 1;
+	}
+
+	// requests are never waited for.
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	echo_flush();
+	fprintf(stderr, "# MPW Shell - listening on %s\n", path.c_str());
+
+	for(;;) {
+		int c = accept(s, nullptr, nullptr);
+		if (c < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			perror("accept");
+			close(s);
+			return 1;
+		}
+		fcntl(c, F_SETFD, FD_CLOEXEC);
+
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			close(c);
+			continue;
+		}
+		if (pid == 0) {
+			close(s);
+			signal(SIGCHLD, SIG_DFL);
+			signal(SIGPIPE, SIG_DFL);
+			_exit(run_request(env, c));
+		}
+		close(c);
+	}
+}
+
+
+bool shell_forward(const std::string &path, const shell_request &rq, int &status) {
+
+	struct sockaddr_un addr;
+	if (!make_address(path, addr)) return false;
+
+	int s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0) return false;
+	fcntl(s, F_SETFD, FD_CLOEXEC);
+
+	if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(s);
+		return false;
+	}
+
+	if (!send_request(s, rq)) {
+		close(s);
+		return false;
+	}
+
+	int32_t rv;
+	if (read_all(s, (char *)&rv, sizeof(rv))) status = rv;
+	else status = -9; // the request died.
+	close(s);
+	return true;
+}
@@ -0,0 +1,32 @@
+#ifndef __shell_server_h__
+#define __shell_server_h__
+
+#include <string>
+#include <vector>
+
+class Environment;
+
+/*
+ * mpw-shell -S socket keeps a started-up shell resident and runs requests
+ * from mpw-shell -s socket (or $MPW_SHELL_SOCKET) on a unix domain socket.
+ *
+ * a request is the client's directory, -D definitions and a -c string (or
+ * its stdin), plus the client's stdin, stdout and stderr (SCM_RIGHTS).
+ * each request runs in a forked copy of the server, so it can't change the
+ * server's environment.  the reply is the status.  closing the client
+ * interrupts the request.
+ */
+struct shell_request {
+	std::string directory;
+	std::vector<std::string> defines;
+	std::string command; // -c
+	bool use_stdin = false;
+};
+
+// runs until killed.  returns non-zero if the socket can't be set up.
+int shell_serve(const Environment &env, const std::string &path);
+
+// returns false if there's no server (the caller runs the request itself).
+bool shell_forward(const std::string &path, const shell_request &rq, int &status);
+
+#endif
@@ -0,0 +1,231 @@
+#include "stat_cache.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cxx/mapped_file.h"
+
+namespace {
+
+	const char magic[8] = { 'M', 'P', 'W', 'S', 'T', 'A', 'T', '3' };
+
+	struct header {
+		char magic[8];
+		uint32_t count;
+		uint32_t reserved;
+		uint64_t strings; // size of the string pool
+	};
+
+	enum { record_exists = 1 };
+
+	struct record {
+		uint64_t offset; // into the string pool
+		uint32_t length;
+		uint32_t flags;
+		int64_t mtime;
+		int64_t mtime_nsec;
+		uint64_t size;
+		uint64_t inode;
+	};
+
+	// below this, threads cost more than they save.
+	const size_t thread_min = 256;
+
+	// stat every path, spread over several threads.
+	std::vector<stat_cache::entry> stat_all(const std::vector<const std::string *> &paths) {
+		std::vector<stat_cache::entry> rv(paths.size());
+		auto worker = [&](size_t first, size_t last) {
+			for (size_t i = first; i < last; ++i) rv[i] = stat_cache::stat(*paths[i]);
+		};
+
+		size_t n = 1;
+		if (paths.size() >= thread_min)
+			n = std::min<size_t>({ std::max(1u, std::thread::hardware_concurrency()), 8, paths.size() / thread_min });
+
+		std::vector<std::thread> threads;
+		size_t chunk = (paths.size() + n - 1) / n;
+		for (size_t i = 1; i < n; ++i)
+			threads.emplace_back(worker, i * chunk, std::min(paths.size(), (i + 1) * chunk));
+		worker(0, std::min(paths.size(), chunk));
+		for (auto &t : threads) t.join();
+		return rv;
+	}
+
+}
+
+
+stat_cache::entry stat_cache::stat(const std::string &path) {
+	entry e;
+#if defined(STATX_BASIC_STATS) && defined(AT_STATX_DONT_SYNC)
+	struct statx stx;
+	if (statx(AT_FDCWD, path.c_str(), AT_STATX_DONT_SYNC, STATX_MTIME | STATX_SIZE | STATX_INO, &stx) == 0) {
+		e.exists = true;
+		e.mtime = stx.stx_mtime.tv_sec;
+		e.mtime_nsec = stx.stx_mtime.tv_nsec;
+		e.size = stx.stx_size;
+		e.inode = stx.stx_ino;
+	}
+#else
+	struct stat st;
+	if (::stat(path.c_str(), &st) == 0) {
+		e.exists = true;
+		e.mtime = st.st_mtime;
+		e.size = st.st_size;
+		e.inode = st.st_ino;
+	}
+#endif
+	return e;
+}
+
+
+bool stat_cache::open(const std::string &path) {
+
+	_path = path;
+	_map.clear();
+
+	std::error_code ec;
+	const mapped_file mf(path, mapped_file::readonly, ec);
+	if (ec) return false;
+
+	const unsigned char *begin = mf.begin();
+	size_t size = mf.size();
+
+	header h;
+	if (size < sizeof(h)) return false;
+	memcpy(&h, begin, sizeof(h));
+	if (memcmp(h.magic, magic, sizeof(magic))) return false;
+
+	size_t records = sizeof(h) + (size_t)h.count * sizeof(record);
+	if (records > size || size - records != h.strings) return false;
+	const char *strings = (const char *)begin + records;
+
+	std::vector<std::pair<std::string, entry>> files;
+	files.reserve(h.count);
+	for (uint32_t i = 0; i < h.count; ++i) {
+		record r;
+		memcpy(&r, begin + sizeof(h) + i * sizeof(record), sizeof(r));
+		if (r.offset > h.strings || r.length > h.strings - r.offset) return false;
+
+		entry e;
+		e.exists = r.flags & record_exists;
+		e.mtime = r.mtime;
+		e.mtime_nsec = r.mtime_nsec;
+		e.size = r.size;
+		e.inode = r.inode;
+		files.emplace_back(std::string(strings + r.offset, r.length), e);
+	}
+
+	// revalidate everything up front -- a file rewritten in place keeps its
+	// directory's date, so nothing short of a stat notices.
+	std::vector<const std::string *> paths;
+	paths.reserve(files.size());
+	for (const auto &kv : files) paths.push_back(&kv.first);
+	auto fresh = stat_all(paths);
+	_stats += paths.size();
+
+	_map.reserve(files.size());
+	for (size_t i = 0; i < files.size(); ++i) {
+		if (fresh[i] != files[i].second) ++_changed;
+		_map[files[i].first].e = fresh[i];
+	}
+	return true;
+}
+
+
+bool stat_cache::save() {
+
+	if (_path.empty()) return false;
+
+	// only what was looked up this time.
+	std::vector<std::pair<const std::string *, const entry *>> files;
+	for (const auto &kv : _map) {
+		if (!kv.second.used) continue;
+		files.emplace_back(&kv.first, &kv.second.e);
+	}
+
+	header h = {};
+	memcpy(h.magic, magic, sizeof(magic));
+
+	std::vector<record> records;
+	std::string strings;
+	records.reserve(files.size());
+
+	auto add = [&](const std::string &name, const entry &e) {
+		record r = {};
+		r.offset = strings.size();
+		r.length = name.size();
+		r.flags = e.exists ? record_exists : 0;
+		r.mtime = e.mtime;
+		r.mtime_nsec = e.mtime_nsec;
+		r.size = e.size;
+		r.inode = e.inode;
+		records.push_back(r);
+		strings += name;
+	};
+
+	for (const auto &kv : files) add(*kv.first, *kv.second);
+	h.count = records.size();
+	h.strings = strings.size();
+
+	// write a temp file and rename so a reader never sees half a cache.
+	std::string temp = _path + ".tmp";
+	int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd < 0) return false;
+
+	auto write_all = [fd](const void *data, size_t size) {
+		const char *cp = (const char *)data;
+		while (size) {
+			ssize_t rv = write(fd, cp, size);
+			if (rv < 0) {
+				if (errno == EINTR) continue;
+				return false;
+			}
+			cp += rv;
+			size -= rv;
+		}
+		return true;
+	};
+
+	bool ok = write_all(&h, sizeof(h))
+		&& write_all(records.data(), records.size() * sizeof(record))
+		&& write_all(strings.data(), strings.size());
+	close(fd);
+
+	if (!ok || rename(temp.c_str(), _path.c_str()) < 0) {
+		unlink(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+bool stat_cache::lookup(const std::string &path, entry &e) {
+	auto iter = _map.find(path);
+	if (iter != _map.end()) {
+		++_hits;
+		iter->second.used = true;
+		e = iter->second.e;
+		return e.exists;
+	}
+	++_misses;
+	++_stats;
+	e = stat(path);
+	item &i = _map[path];
+	i.e = e;
+	i.used = true;
+	return e.exists;
+}
+
+
+void stat_cache::invalidate(const std::string &path) {
+	_map.erase(path);
+}
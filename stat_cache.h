@@ -0,0 +1,72 @@
+#ifndef __stat_cache_h__
+#define __stat_cache_h__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/*
+ * file metadata (mtime, size, inode) for make's up-to-date checks, saved
+ * between runs in a memory-mapped file.
+ *
+ * open() loads the saved entries and revalidates all of them at once with
+ * statx, spread over several threads, so later lookups are memory reads.
+ * paths that weren't in the file are stat-ed on demand and added.  missing
+ * files are cached too.  save() keeps only the entries looked up since
+ * open(), so files make no longer asks about drop out.
+ */
+class stat_cache {
+
+public:
+
+	struct entry {
+		int64_t mtime = 0;
+		int64_t mtime_nsec = 0;
+		uint64_t size = 0;
+		uint64_t inode = 0;
+		bool exists = false;
+
+		bool operator==(const entry &rhs) const noexcept {
+			return exists == rhs.exists && mtime == rhs.mtime && mtime_nsec == rhs.mtime_nsec
+				&& size == rhs.size && inode == rhs.inode;
+		}
+		bool operator!=(const entry &rhs) const noexcept { return !(*this == rhs); }
+	};
+
+	stat_cache() = default;
+	stat_cache(const stat_cache &) = delete;
+	stat_cache &operator=(const stat_cache &) = delete;
+
+	// returns false if the file is missing or invalid (the cache starts empty).
+	bool open(const std::string &path);
+	bool save();
+
+	// unix path.  returns e.exists.
+	bool lookup(const std::string &path, entry &e);
+	void invalidate(const std::string &path);
+
+	size_t size() const noexcept { return _map.size(); }
+	uint64_t hits() const noexcept { return _hits; }
+	uint64_t misses() const noexcept { return _misses; }
+	uint64_t changed() const noexcept { return _changed; }
+	// stat calls, including revalidation.
+	uint64_t stats() const noexcept { return _stats; }
+
+	static entry stat(const std::string &path);
+
+private:
+
+	struct item {
+		entry e;
+		bool used = false;
+	};
+
+	std::string _path;
+	std::unordered_map<std::string, item> _map;
+	uint64_t _hits = 0;
+	uint64_t _misses = 0;
+	uint64_t _changed = 0;
+	uint64_t _stats = 0;
+};
+
+#endif
@@ -0,0 +1,477 @@
+#include "tool_cache.h"
+#include "environment.h"
+#include "echo_buffer.h"
+#include "hash128.h"
+#include "include_scanner.h"
+#include "transcode.h"
+
+#include <algorithm>
+#include <set>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "cxx/filesystem.h"
+
+namespace fs = filesystem;
+
+namespace ToolBox {
+	std::string MacToUnix(const std::string path);
+}
+
+fs::path mpw_path();
+
+namespace {
+
+	const char *version = "mpw-shell tool cache 1";
+
+	bool read_all(const std::string &path, std::string &out) {
+		int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) return false;
+		char buffer[65536];
+		out.clear();
+		for(;;) {
+			ssize_t size = read(fd, buffer, sizeof(buffer));
+			if (size < 0 && errno == EINTR) continue;
+			if (size < 0) { close(fd); return false; }
+			if (size == 0) break;
+			out.append(buffer, size);
+		}
+		close(fd);
+		return true;
+	}
+
+	bool copy_fd(int from, int to) {
+		char buffer[65536];
+		for(;;) {
+			ssize_t size = read(from, buffer, sizeof(buffer));
+			if (size < 0 && errno == EINTR) continue;
+			if (size < 0) return false;
+			if (size == 0) return true;
+			const char *cp = buffer;
+			while (size) {
+				ssize_t rv = write(to, cp, size);
+				if (rv < 0) {
+					if (errno == EINTR) continue;
+					return false;
+				}
+				cp += rv;
+				size -= rv;
+			}
+		}
+	}
+
+	bool copy_file(const std::string &from, const std::string &to) {
+		int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+		if (in < 0) return false;
+		int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (out < 0) { close(in); return false; }
+		bool ok = copy_fd(in, out);
+		close(in);
+		close(out);
+		return ok;
+	}
+
+	// write captured output to an fd.  the cache has the tool's own bytes;
+	// {TranscodeOutput} applies to the real destination, as if it had run.
+	void replay(int in, int fd, bool transcode) {
+		if (transcode && transcode_target(fd)) transcode_output(in, fd, -1, -1);
+		else copy_fd(in, fd);
+	}
+
+	void replay(const std::string &path, int fd, bool transcode) {
+		int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (in < 0) return;
+		replay(in, fd, transcode);
+		close(in);
+	}
+
+	int temp_file() {
+		char temp[32] = "/tmp/mpw-shell-XXXXXXXX";
+		int fd = mkstemp(temp);
+		if (fd < 0) return -1;
+		unlink(temp);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		return fd;
+	}
+
+	struct timespec modified(const struct stat &st) {
+#if defined(__APPLE__)
+		return st.st_mtimespec;
+#else
+		return st.st_mtim;
+#endif
+	}
+
+	template<class FX>
+	void each_entry(const std::string &dir, FX &&fx) {
+		DIR *dp = opendir(dir.c_str());
+		if (!dp) return;
+		while (struct dirent *d = readdir(dp)) {
+			if (d->d_name[0] == '.') continue;
+			fx(std::string(d->d_name));
+		}
+		closedir(dp);
+	}
+
+	// entries are flat directories.
+	uint64_t remove_entry(const std::string &path) {
+		uint64_t bytes = 0;
+		each_entry(path, [&](const std::string &name){
+			std::string p = path + "/" + name;
+			struct stat st;
+			if (stat(p.c_str(), &st) == 0) bytes += st.st_size;
+			unlink(p.c_str());
+		});
+		rmdir(path.c_str());
+		return bytes;
+	}
+
+	std::string add_slash(std::string s) {
+		if (!s.empty() && s.back() != '/') s.push_back('/');
+		return s;
+	}
+
+	bool parse_statistics(const std::string &s, tool_cache::statistics &st) {
+		unsigned long long v[5];
+		if (sscanf(s.c_str(), "%llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4]) != 5) return false;
+		st.hits = v[0];
+		st.misses = v[1];
+		st.stores = v[2];
+		st.evictions = v[3];
+		st.bytes = v[4];
+		return true;
+	}
+
+	/*
+	 * the stats file is shared by every shell using the cache.  fx updates
+	 * it with the lock held.
+	 */
+	template<class FX>
+	tool_cache::statistics with_statistics(const std::string &dir, FX &&fx) {
+		tool_cache::statistics st;
+		std::string path = dir + "/stats";
+		int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+		if (fd < 0) return st;
+		flock(fd, LOCK_EX);
+
+		char buffer[256];
+		ssize_t size = pread(fd, buffer, sizeof(buffer) - 1, 0);
+		if (size > 0) {
+			buffer[size] = 0;
+			parse_statistics(buffer, st);
+		}
+
+		fx(st);
+
+		int len = snprintf(buffer, sizeof(buffer), "%llu %llu %llu %llu %llu\n",
+			(unsigned long long)st.hits, (unsigned long long)st.misses,
+			(unsigned long long)st.stores, (unsigned long long)st.evictions,
+			(unsigned long long)st.bytes);
+		if (pwrite(fd, buffer, len, 0) == len) ftruncate(fd, len);
+
+		flock(fd, LOCK_UN);
+		close(fd);
+		return st;
+	}
+
+}
+
+
+tool_cache::tool_cache(const Environment &env, const std::vector<std::string> &argv, const fdmask &fds) : _fds(fds) {
+
+	std::string dir = env.get("toolcache");
+	if (dir.empty() || argv.empty()) return;
+
+	// input from a redirection can't be hashed.
+	if (fds[0] != STDIN_FILENO) return;
+
+	std::vector<std::string> search;
+	std::set<std::string> outputs;
+	bool append = false;
+
+	for (size_t i = 1; i < argv.size(); ++i) {
+		const std::string &s = argv[i];
+		if (s == "-a") append = true;
+		if (i + 1 == argv.size()) continue;
+		if (s == "-o") {
+			_outputs.push_back(ToolBox::MacToUnix(argv[i + 1]));
+			outputs.insert(argv[i + 1]);
+		}
+		if (s == "-i") search.push_back(add_slash(ToolBox::MacToUnix(argv[i + 1])));
+	}
+	if (_outputs.empty()) return;
+
+	// -o :obj: -- the file names aren't known.
+	for (const auto &o : _outputs) {
+		struct stat st;
+		if (stat(o.c_str(), &st) == 0 && !S_ISREG(st.st_mode)) return;
+	}
+
+	hash128 h;
+	h.update(std::string(version));
+
+	struct stat st;
+	if (stat(argv[0].c_str(), &st) != 0) return;
+	h.update(argv[0]);
+	h.update(st.st_size);
+	h.update(st.st_mtime);
+	h.update(std::string(mpw_path()));
+
+	char cwd[PATH_MAX];
+	if (!getcwd(cwd, sizeof(cwd))) return;
+	h.update(std::string(cwd));
+
+	h.update(argv.size());
+	for (const auto &s : argv) h.update(s);
+
+	for (const auto &kv : env) {
+		if (!kv.second) continue;
+		h.update(kv.first);
+		h.update((const std::string &)kv.second);
+	}
+	// output is saved unconverted, so {TranscodeOutput} isn't part of the key.
+	_transcode = env.transcode();
+
+	// an existing output is only an input when appending (Rez -a).
+	std::vector<std::string> files;
+	for (size_t i = 1; i < argv.size(); ++i) {
+		if (!append && outputs.count(argv[i])) continue;
+		std::string path = ToolBox::MacToUnix(argv[i]);
+		if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) files.push_back(path);
+	}
+
+	// headers are found the same way ScanIncludes finds them.
+	include_scanner scanner(env);
+	scanner.search_first(search);
+	auto includes = scanner.scan(files, 1, true);
+
+	std::set<std::string> seen;
+	auto hash_file = [&](const std::string &path) {
+		if (!seen.insert(path).second) return;
+		std::string data;
+		if (!read_all(path, data)) {
+			h.update("unreadable:" + path);
+			return;
+		}
+		h.update(path);
+		h.update(data);
+	};
+	for (size_t i = 0; i < files.size(); ++i) {
+		hash_file(files[i]);
+		for (const auto &inc : includes[i]) hash_file(inc);
+	}
+
+	_dir = ToolBox::MacToUnix(dir);
+	while (_dir.size() > 1 && _dir.back() == '/') _dir.pop_back();
+	_key = h.hex();
+
+	long mb = strtol(env.get("toolcachesize").c_str(), nullptr, 10);
+	if (mb <= 0) mb = 1024;
+	_limit = (uint64_t)mb << 20;
+
+	mkdir(_dir.c_str(), 0777);
+	_active = true;
+}
+
+
+tool_cache::~tool_cache() {
+	if (_out >= 0) close(_out);
+	if (_err >= 0) close(_err);
+}
+
+
+fdmask tool_cache::fds() const {
+	if (_out < 0) return _fds;
+	return fdmask(_fds[0], _out, _err);
+}
+
+
+bool tool_cache::restore() {
+
+	if (!_active) return false;
+
+	std::string entry = _dir + "/" + _key.substr(0, 2) + "/" + _key;
+	std::string manifest;
+	if (read_all(entry + "/manifest", manifest)) {
+
+		bool ok = true;
+		for (size_t i = 0; ok && i < _outputs.size(); ++i)
+			ok = copy_file(entry + "/" + std::to_string(i), _outputs[i]);
+
+		if (ok) {
+			echo_flush();
+			replay(entry + "/stdout", _fds[1], _transcode);
+			replay(entry + "/stderr", _fds[2], _transcode);
+
+			// lru -- the entry's date is its last use.
+			utimensat(AT_FDCWD, entry.c_str(), nullptr, 0);
+			update_statistics(1, 0, 0, 0);
+			return true;
+		}
+	}
+
+	update_statistics(0, 1, 0, 0);
+	_out = temp_file();
+	_err = temp_file();
+	if (_out < 0 || _err < 0) _active = false;
+	return false;
+}
+
+
+void tool_cache::store(int status) {
+
+	if (_out < 0 || _err < 0) return;
+
+	lseek(_out, 0, SEEK_SET);
+	lseek(_err, 0, SEEK_SET);
+	replay(_out, _fds[1], _transcode);
+	replay(_err, _fds[2], _transcode);
+
+	if (!_active || status != 0) return;
+
+	std::string temp = _dir + "/tmp.XXXXXX";
+	if (!mkdtemp(&temp[0])) return;
+
+	bool ok = true;
+	for (size_t i = 0; ok && i < _outputs.size(); ++i)
+		ok = copy_file(_outputs[i], temp + "/" + std::to_string(i));
+
+	for (int fd : { _out, _err }) {
+		if (!ok) break;
+		std::string path = temp + (fd == _out ? "/stdout" : "/stderr");
+		int out = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		if (out < 0) { ok = false; break; }
+		lseek(fd, 0, SEEK_SET);
+		ok = copy_fd(fd, out);
+		close(out);
+	}
+
+	// written last -- an entry without a manifest is incomplete.
+	if (ok) {
+		std::string list;
+		for (const auto &o : _outputs) list += o + "\n";
+		int out = open((temp + "/manifest").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		ok = out >= 0 && write(out, list.data(), list.size()) == (ssize_t)list.size();
+		if (out >= 0) close(out);
+	}
+
+	uint64_t bytes = 0;
+	each_entry(temp, [&](const std::string &name){
+		struct stat st;
+		if (stat((temp + "/" + name).c_str(), &st) == 0) bytes += st.st_size;
+	});
+
+	std::string prefix = _dir + "/" + _key.substr(0, 2);
+	mkdir(prefix.c_str(), 0777);
+	if (!ok || rename(temp.c_str(), (prefix + "/" + _key).c_str()) < 0) {
+		// failed, or another shell stored it first.
+		remove_entry(temp);
+		return;
+	}
+
+	auto st = with_statistics(_dir, [bytes](statistics &st){
+		st.stores++;
+		st.bytes += bytes;
+	});
+	if (st.bytes > _limit) evict();
+}
+
+
+void tool_cache::update_statistics(int hits, int misses, int stores, uint64_t bytes) {
+	with_statistics(_dir, [=](statistics &st){
+		st.hits += hits;
+		st.misses += misses;
+		st.stores += stores;
+		st.bytes += bytes;
+	});
+}
+
+
+void tool_cache::evict() {
+
+	struct item {
+		std::string path;
+		uint64_t bytes;
+		struct timespec used;
+	};
+
+	std::vector<item> items;
+	uint64_t total = 0;
+
+	each_entry(_dir, [&](const std::string &prefix){
+		if (prefix.size() != 2) return;
+		std::string p = _dir + "/" + prefix;
+		each_entry(p, [&](const std::string &name){
+			item i = { p + "/" + name, 0, {} };
+			struct stat st;
+			if (stat(i.path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return;
+			i.used = modified(st);
+			each_entry(i.path, [&](const std::string &file){
+				struct stat fst;
+				if (stat((i.path + "/" + file).c_str(), &fst) == 0) i.bytes += fst.st_size;
+			});
+			total += i.bytes;
+			items.push_back(std::move(i));
+		});
+	});
+
+	std::sort(items.begin(), items.end(), [](const item &a, const item &b){
+		if (a.used.tv_sec != b.used.tv_sec) return a.used.tv_sec < b.used.tv_sec;
+		return a.used.tv_nsec < b.used.tv_nsec;
+	});
+
+	// leave some room so every store doesn't trigger a scan.
+	uint64_t target = _limit / 10 * 9;
+	uint64_t evicted = 0;
+	for (const auto &i : items) {
+		if (total <= target) break;
+		remove_entry(i.path);
+		total -= i.bytes;
+		++evicted;
+	}
+
+	with_statistics(_dir, [=](statistics &st){
+		st.evictions += evicted;
+		st.bytes = total;
+	});
+}
+
+
+bool tool_cache::read_statistics(const std::string &dir, statistics &s) {
+	std::string data;
+	if (!read_all(ToolBox::MacToUnix(dir) + "/stats", data)) return false;
+	return parse_statistics(data, s);
+}
+
+
+void tool_cache::clear(const std::string &dir, bool statistics_only) {
+
+	std::string d = ToolBox::MacToUnix(dir);
+
+	if (!statistics_only) {
+		each_entry(d, [&](const std::string &prefix){
+			std::string p = d + "/" + prefix;
+			if (prefix.size() == 2) {
+				each_entry(p, [&](const std::string &name){ remove_entry(p + "/" + name); });
+				rmdir(p.c_str());
+			}
+			else if (prefix.compare(0, 4, "tmp.") == 0) remove_entry(p);
+		});
+	}
+
+	with_statistics(d, [=](statistics &st){
+		uint64_t bytes = st.bytes;
+		st = statistics();
+		if (statistics_only) st.bytes = bytes;
+	});
+}
@@ -0,0 +1,72 @@
+#ifndef __tool_cache_h__
+#define __tool_cache_h__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fdset.h"
+
+class Environment;
+
+/*
+ * ccache for MPW tools.  enabled by setting {ToolCache} to a directory.
+ *
+ * the key covers the tool (path, size and date), the arguments, the
+ * directory, every exported variable, and the contents of every file
+ * named on the command line plus anything they include (as found by
+ * include_scanner, with the tool's -i directories first).  only commands
+ * with -o outputs are cached, and only when they succeed.
+ *
+ * on a hit the -o files, stdout and stderr are restored and the tool
+ * isn't run.  stdout and stderr are saved as the tool wrote them and
+ * converted ({TranscodeOutput}) when they're passed on.  {ToolCacheSize} (in MB, default 1024) limits the directory;
+ * the least recently used entries are removed first.
+ */
+class tool_cache {
+
+public:
+
+	struct statistics {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t stores = 0;
+		uint64_t evictions = 0;
+		uint64_t bytes = 0;
+	};
+
+	tool_cache(const Environment &env, const std::vector<std::string> &argv, const fdmask &fds);
+	~tool_cache();
+
+	tool_cache(const tool_cache &) = delete;
+	tool_cache &operator=(const tool_cache &) = delete;
+
+	// returns true (and writes the saved output) on a hit.
+	bool restore();
+
+	// fds for the tool -- stdout and stderr are captured on a miss.
+	fdmask fds() const;
+
+	// pass the captured output on and save it if the tool succeeded.
+	void store(int status);
+
+	static bool read_statistics(const std::string &dir, statistics &s);
+	static void clear(const std::string &dir, bool statistics_only);
+
+private:
+
+	void update_statistics(int hits, int misses, int stores, uint64_t bytes);
+	void evict();
+
+	bool _active = false;
+	bool _transcode = false;
+	fdmask _fds;
+	std::string _dir;
+	std::string _key;
+	uint64_t _limit = 0;
+	std::vector<std::string> _outputs;
+	int _out = -1;
+	int _err = -1;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "transcode.h"
+#include "macroman.h"
+
+#include <cerrno>
+
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+	constexpr size_t buffer_size = 16 * 1024;
+
+	// returns false if the output is gone; the input is still drained.
+	bool write_all(int fd, const uint8_t *data, size_t size) {
+		while (size) {
+			ssize_t rv = ::write(fd, data, size);
+			if (rv < 0) {
+				if (errno == EINTR) continue;
+				return false;
+			}
+			data += rv;
+			size -= rv;
+		}
+		return true;
+	}
+
+}
+
+void transcode_output(int out_in, int out_fd, int err_in, int err_fd) {
+
+	uint8_t in[buffer_size];
+	uint8_t out[buffer_size * 3];
+
+	struct pollfd pfd[2] = {
+		{ out_in, POLLIN, 0 },
+		{ err_in, POLLIN, 0 },
+	};
+	int targets[2] = { out_fd, err_fd };
+
+	// poll ignores negative fds.
+	while (pfd[0].fd >= 0 || pfd[1].fd >= 0) {
+
+		int rv = poll(pfd, 2, -1);
+		if (rv < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+
+		for (unsigned i = 0; i < 2; ++i) {
+			if (pfd[i].fd < 0 || !pfd[i].revents) continue;
+
+			ssize_t size = read(pfd[i].fd, in, sizeof(in));
+			if (size < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+			if (size <= 0) {
+				pfd[i].fd = -1;
+				continue;
+			}
+			if (targets[i] < 0) continue;
+
+			size_t n = macroman_to_utf8(in, size, out);
+			if (!write_all(targets[i], out, n)) targets[i] = -1;
+		}
+	}
+}
+
+
+bool transcode_target(int fd) {
+	struct stat st;
+	if (isatty(fd)) return true;
+	if (fstat(fd, &st) < 0) return false;
+	return S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode);
+}
@@ -0,0 +1,17 @@
+#ifndef __transcode_h__
+#define __transcode_h__
+
+/*
+ * {TranscodeOutput} -- external commands write to pipes and their MacRoman
+ * output is converted to utf-8 on the way to the real stdout / stderr.
+ *
+ * copies out_in -> out_fd and err_in -> err_fd until both reach end of file.
+ * either input may be -1.  the inputs are not closed.
+ */
+
+void transcode_output(int out_in, int out_fd, int err_in, int err_fd);
+
+// terminals and pipes get converted output; files (> ≥ ∑) don't.
+bool transcode_target(int fd);
+
+#endif